@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class TH2D;
+class FuzzyAccumulator;
+
+/**
+ * mean and width estimators for the y distribution of each x bin of a
+ * fuzzy template
+ */
+
+struct binEstimate {
+  double mean;
+  double sigma;
+};
+
+/**
+ * @brief chi2 gaussian fit to a histogram column, in the range
+ * [mean - 3 rms, mean + 3 rms] like TH1::Fit("gaus") on a projection
+ *
+ * counts[i] is the content of the bin centered at yLow + (i + 0.5) * width.
+ * Empty bins are ignored and bin errors are sqrt(counts), as in a ROOT
+ * chi2 fit. Thread safe
+ */
+binEstimate gausFitColumn(const double* counts, int nBins, double yLow,
+                          double width);
+
+/**
+ * @brief closed form estimate: mean and rms restricted to
+ * [mean - 3 rms, mean + 3 rms], rms corrected for the truncation of a
+ * gaussian at 3 sigma
+ */
+binEstimate momentsColumn(const double* counts, int nBins, double yLow,
+                          double width);
+
+/**
+ * @brief estimate mean and sigma of every x bin of h
+ *
+ * method is "rootGaus" (serial TH1::Fit of each projection), "gaus"
+ * (gausFitColumn) or "moments" (momentsColumn). The last two run on nThreads
+ * threads
+ */
+std::vector<binEstimate> estimateBins(const TH2D& h, const std::string& method,
+                                      int nThreads);
+
+/**
+ * @brief estimateBins on the counts of an accumulator, without going
+ * through a TH2D except for "rootGaus"
+ */
+std::vector<binEstimate> estimateBins(const FuzzyAccumulator& fuzzy,
+                                      const std::string& method,
+                                      int nThreads);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+
+#include "Rtypes.h"
+#include "TTree.h"
+
+#include "outputWriter.hh"
+
+/**
+ * checkpoints of a pulse analysis run, so an interrupted job can resume.
+ * A checkpoint is a small json file next to the output recording the input,
+ * the entry range and the next entry to process
+ */
+
+namespace checkpoint {
+
+struct state {
+  std::string input;
+  Long64_t firstEntry;
+  Long64_t endEntry;
+  Long64_t nextEntry;
+};
+
+/**
+ * @brief checkpoint file belonging to output file outName
+ */
+std::string pathFor(const std::string& outName);
+
+/**
+ * @brief read a checkpoint, false if there is none
+ */
+bool read(const std::string& path, state& st);
+
+/**
+ * @brief write st to path, replacing the old checkpoint atomically
+ */
+void write(const std::string& path, const state& st);
+}
+
+/**
+ * @brief saves a checkpoint every interval entries
+ *
+ * a checkpoint waits for the writer to fill every queued entry, AutoSaves
+ * the output tree so it can be recovered from the file, and then records
+ * the next entry
+ */
+class checkpointer {
+public:
+  checkpointer(const std::string& outName, const checkpoint::state& st,
+               Long64_t interval, outputWriter& writer, TTree& tree);
+
+  /**
+   * @brief call after entry has been handed to the writer
+   */
+  void entryDone(Long64_t entry) {
+    if ((interval_ > 0) && (((entry + 1 - st_.firstEntry) % interval_) == 0)) {
+      save(entry + 1);
+    }
+  }
+
+  void save(Long64_t nextEntry);
+
+private:
+  std::string path_;
+  checkpoint::state st_;
+  Long64_t interval_;
+  outputWriter& writer_;
+  TTree& tree_;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Rtypes.h"
+
+#include "common.hh"
+#include "daqStructs.hh"
+
+/**
+ * compile time description of each digitizer's raw event struct, used to
+ * specialise code that reads traces for every board
+ */
+
+struct caen5730Trait {
+  typedef daq::caen_5730 event;
+  static const int nChannels = CAEN_5730_CH;
+  static const int traceLength = CAEN_5730_LN;
+  static const char* type() { return "caen5730"; }
+  static void* branchAddress(event& e) { return &e.event_index; }
+  static const UShort_t* trace(const event& e, int channel) {
+    return e.trace[channel];
+  }
+};
+
+struct caen1742Trait {
+  typedef caen_1742 event;
+  static const int nChannels = CAEN_1742_CH;
+  static const int traceLength = CAEN_1742_LN;
+  static const char* type() { return "caen1742"; }
+  static void* branchAddress(event& e) { return &e.system_clock; }
+  static const UShort_t* trace(const event& e, int channel) {
+    return e.trace[channel];
+  }
+};
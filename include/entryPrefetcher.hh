@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Rtypes.h"
+
+#include "fitterStructs.hh"
+#include "pulseProcessing.hh"
+
+class TBranch;
+
+/**
+ * @brief reads ROOT input entries on a background thread
+ *
+ * a reader thread calls GetEntry for entries [firstEntry, endEntry) on its
+ * own view of the input, with the digitizer branches pointed at a ring of
+ * depth raw event buffers, so entries are decompressed straight into the
+ * ring. readNext hands the entries out in order, so decompression of the
+ * next entries overlaps with fitting the current one
+ */
+class entryPrefetcher {
+public:
+  entryPrefetcher(const inputSource& source,
+                  const std::vector<std::unique_ptr<digitizer>>& digs,
+                  Long64_t firstEntry, Long64_t endEntry, std::size_t depth);
+  ~entryPrefetcher();
+
+  /**
+   * @brief point the trace bases of plan, built for digs, into the ring
+   *
+   * the daq structs of digs are not filled in prefetch mode, processEntry
+   * reads the traces of an entry from its ring slot
+   */
+  void retarget(executionPlan& plan,
+                const std::vector<std::unique_ptr<digitizer>>& digs) const;
+
+  /**
+   * @brief wait for the next entry and release the previous one
+   *
+   * @return the ring slot of the entry, the entry index to pass to
+   * processEntry for a retargeted plan. The slot stays valid until the next
+   * call
+   */
+  Long64_t readNext();
+
+private:
+  void run();
+
+  inputSource input_;
+  std::vector<std::unique_ptr<digitizer>> readerDigs_;
+  std::vector<TBranch*> branches_;
+  Long64_t nextRead_;
+  Long64_t nextHandout_;
+  // entries before nextRelease_ are done with, their slots can be refilled
+  Long64_t nextRelease_;
+  Long64_t endEntry_;
+  std::size_t depth_;
+  // ring of raw events, depth consecutive daq structs per digitizer
+  std::vector<std::vector<char>> rings_;
+  bool stop_;
+  std::mutex mutex_;
+  std::condition_variable slotFilled_;
+  std::condition_variable slotFreed_;
+  std::thread reader_;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Rtypes.h"
+
+#include "fitterStructs.hh"
+#include "pulseProcessing.hh"
+
+/**
+ * event sources for online analysis: a run file that is still being
+ * written, or raw daq structs arriving on a named pipe or UNIX socket
+ */
+class eventFeed {
+public:
+  virtual ~eventFeed() {}
+
+  /**
+   * @brief wait up to timeoutMs for the next event and read it into the
+   * daq structs of the digitizers
+   *
+   * @return false if no event arrived in time
+   */
+  virtual bool next(int timeoutMs) = 0;
+
+  /**
+   * @brief events known to be waiting after the current one
+   */
+  virtual Long64_t backlog() = 0;
+
+  /**
+   * @brief true once no more events can arrive
+   */
+  virtual bool finished() const = 0;
+};
+
+/**
+ * @brief follow the "t" tree of a run file that the daq keeps AutoSaving
+ *
+ * source is opened on fileName with openInput, new entries are picked up
+ * with TTree::Refresh
+ */
+std::unique_ptr<eventFeed> makeGrowingFileFeed(
+    const std::string& fileName, inputSource& source,
+    std::vector<std::unique_ptr<digitizer>>& digs, Long64_t treeCacheSize);
+
+/**
+ * @brief read caen_5730 structs, as written by the daq, from a named pipe
+ * or a UNIX stream socket at path into the caen5730 digitizer of digs,
+ * which must be the only one
+ *
+ * the feed is finished when the writer closes the pipe or socket
+ */
+std::unique_ptr<eventFeed> makeStreamFeed(
+    const std::string& path, std::vector<std::unique_ptr<digitizer>>& digs);
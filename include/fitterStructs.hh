@@ -3,25 +3,51 @@
 #include "Rtypes.h"
 #include "TSpline.h"
 #include "TemplateFitter.hh"
+#include "tabulatedTemplate.hh"
+#include "templateBundle.hh"
+#include "linearTemplateFit.hh"
+#include "quickEstimators.hh"
+#include "runStatistics.hh"
 
 #include <memory>
 #include <map>
 #include <string>
 
 #include "common.hh"
+#include "daqStructs.hh"
 
 /**
  * structs used in pulse analysis program
  */
 
+// bits of pulseSummary::flags
+enum pulseFlag {
+  // the search window reached past the trace, or its trigger was missing,
+  // and was clipped to the trace
+  flagWindowClipped = 1,
+  // the extremum is on the first or last sample of the search window
+  flagPeakOnEdge = 2,
+  // the fit window around the extremum is not inside the trace, only the
+  // quick estimators were filled
+  flagFitOutside = 4,
+  // the group trigger trace held no pulse, the time is not trigger
+  // corrected and a trigger relative search window covers the whole trace
+  flagNoTrigger = 8
+};
+
 struct pulseSummary {
   Double_t energy;
   Double_t baseline;
   Double_t threeSampleAmpl;
+  // in trace samples for fitted and quick estimate only rows alike
   Double_t time;
   Double_t threeSampleTime;
   Double_t chi2;
+  // pulseFlag bits
+  UInt_t flags;
   Bool_t fitConverged;
+  // false if only the quick estimators were filled
+  Bool_t fitted;
 };
 
 struct fitConfiguration {
@@ -31,26 +57,75 @@ struct fitConfiguration {
   UInt_t fitLength;
   UInt_t peakIndex;
   UInt_t wiggleRoom;
+  // pulses whose quick, baseline subtracted amplitude is below fitThreshold
+  // keep the quick estimates and are not fitted. 0 fits every pulse
+  Double_t fitThreshold;
+  // the extremum is searched for in searchLength samples from searchStart,
+  // counted from the group trigger time if searchFromTrigger. A length of
+  // 0 searches the whole trace
+  Int_t searchStart;
+  UInt_t searchLength;
+  Bool_t searchFromTrigger;
   Bool_t negPolarity;
   Bool_t draw;
+  // seed the fit time from the three sample estimate instead of the
+  // fixed {0, +1, -1} ladder around peakIndex
+  Bool_t threeSampleSeed;
+  // try the non-iterative linear fit first, with linearFitResolution time
+  // grid points per sample
+  Bool_t linearFit;
+  UInt_t linearFitResolution;
 };
 
 struct detector {
   std::string name;
   fitConfiguration conf;
+  // shared by every detector and clone using the same template file, null
+  // for detectors set up directly from a spline
+  std::shared_ptr<const TemplateBundle> bundle;
   std::unique_ptr<TSpline3> templateSpline;
+  TabulatedTemplate tabTemplate;
   TemplateFitter fitter;
   pulseSummary pSum;
+  // fit scratch space, sized once at setup so fitting doesn't allocate
+  std::vector<UShort_t> fitSamples;
+  TemplateFitter::Output fitOutput;
+  // empty unless conf.linearFit
+  LinearTemplateFit linearFit;
+  fitCounters fitStats;
 };
 
 class digitizer {
 public:
+  digitizer() : triggerCorrection(false), minTriggerAmplitude(0) {}
+  virtual ~digitizer() {}
   virtual UShort_t* getTrace(int i) = 0;
   virtual ULong64_t* getStructAddress() = 0;
+  // bytes of the daq struct starting at getStructAddress
+  virtual std::size_t getStructSize() const = 0;
   virtual std::size_t getTraceLength() const = 0;
+  // digitizers with trigger groups digitize one trigger trace per group
+  virtual std::size_t getNGroups() const { return 0; }
+  virtual std::size_t getGroup(int /*channel*/) const { return 0; }
+  virtual UShort_t* getTriggerTrace(int /*group*/) { return nullptr; }
+  // new digitizer of the same type with independent copies of the detectors
+  virtual std::unique_ptr<digitizer> clone() const = 0;
   std::string type;
   std::string branchName;
   std::vector<detector> detectors;
+  // report pulse times relative to the trigger time of their group
+  bool triggerCorrection;
+  // per event trigger times, one per group, NaN if a group has no trigger
+  std::vector<Double_t> triggerTimes;
+  // smallest trigger pulse height, in counts, accepted as a trigger
+  Double_t minTriggerAmplitude;
+
+  // trigger times are computed for trigger correction and for trigger
+  // relative search windows
+  bool needsTriggerTimes() const;
+
+protected:
+  void copyConfiguration(digitizer& copy) const;
 };
 
 class digitizerCaen5730 : public digitizer {
@@ -58,6 +133,44 @@ public:
   std::size_t getTraceLength() const { return CAEN_5730_LN; }
   UShort_t* getTrace(int i) { return data.trace[i]; }
   ULong64_t* getStructAddress() { return &data.event_index; }
+  std::size_t getStructSize() const { return sizeof(data); }
+  std::unique_ptr<digitizer> clone() const;
 private:
   daq::caen_5730 data; 
 };
+
+class digitizerCaen1742 : public digitizer {
+public:
+  std::size_t getTraceLength() const { return CAEN_1742_LN; }
+  UShort_t* getTrace(int i) { return data.trace[i]; }
+  ULong64_t* getStructAddress() { return &data.system_clock; }
+  std::size_t getStructSize() const { return sizeof(data); }
+  std::size_t getNGroups() const { return CAEN_1742_GR; }
+  std::size_t getGroup(int channel) const {
+    return channel / (CAEN_1742_CH / CAEN_1742_GR);
+  }
+  UShort_t* getTriggerTrace(int group) { return data.trigger[group]; }
+  std::unique_ptr<digitizer> clone() const;
+private:
+  caen_1742 data;
+};
+
+/**
+ * @brief set up det's fitter, tabulated template, linear fit grid and
+ * scratch space from det.templateSpline, det.bundle and det.conf
+ */
+void setFitterTemplate(detector& det);
+
+/**
+ * @brief copy a detector, giving the copy its own template spline and fitter
+ */
+void cloneDetector(const detector& source, detector& copy);
+
+/**
+ * @brief fit the n samples starting at samples with det's fitter
+ *
+ * the samples are copied into det.fitSamples, which must already hold n
+ * elements, and the result is written to out
+ */
+void fitWindow(detector& det, const UShort_t* samples, std::size_t n,
+               double tGuess, TemplateFitter::Output& out);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TH2D;
+
+/**
+ * Counts of a fuzzy template, binned like a TH2D.
+ *
+ * Bin indices are computed arithmetically, with the TAxis::FindBin formula,
+ * and counts are stored as 32 bit integers ordered [x bin][y bin], so the
+ * y distribution of an x bin is one contiguous column. Like in a TH2D, bin
+ * 0 and bin n + 1 of each axis hold under and overflows.
+ */
+class FuzzyAccumulator {
+public:
+  FuzzyAccumulator(int nx, double xLow, double xHigh, int ny, double yLow,
+                   double yHigh);
+
+  /**
+   * @brief fill (x0 + j, values[j]) for j in [0, n)
+   *
+   * the bin indices of the whole window are computed in one branch free
+   * loop before the counts are incremented
+   */
+  void fillWindow(const double* values, int n, double x0);
+
+  /**
+   * @brief add the counts of other, which must have the same binning
+   */
+  void add(const FuzzyAccumulator& other);
+
+  /**
+   * @brief counts of y bins 1 to ny of x bin xBin, in 1 to nx
+   */
+  const std::uint32_t* column(int xBin) const {
+    return &counts_[static_cast<std::size_t>(xBin) * (ny_ + 2) + 1];
+  }
+
+  int getNx() const { return nx_; }
+  int getNy() const { return ny_; }
+  double getYLow() const { return yLow_; }
+  double getYHigh() const { return yHigh_; }
+
+  /**
+   * @brief TH2D with the same binning and contents, for persistence
+   */
+  std::unique_ptr<TH2D> makeHist(const std::string& name,
+                                 const std::string& title) const;
+
+private:
+  int nx_;
+  double xLow_;
+  double xHigh_;
+  int ny_;
+  double yLow_;
+  double yHigh_;
+  // [x bin][y bin], flow bins included
+  std::vector<std::uint32_t> counts_;
+  // bin indices of the window being filled
+  std::vector<std::uint32_t> index_;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "Rtypes.h"
+#include "TemplateFitter.hh"
+
+#include "tabulatedTemplate.hh"
+
+/**
+ * Non-iterative single pulse template fit.
+ *
+ * For a fixed pulse time t the model samples[k] = scale * T(k - t) + pedestal
+ * is linear in scale and pedestal, so its least squares solution only needs
+ * f.y and the sum of the samples, where f holds the template at the sample
+ * times. The template vectors and the inverse normal matrices are
+ * precomputed on a fine grid of times around the expected pulse time.
+ * A fit is a coarse then fine grid search of the chi2 over time, refined
+ * with a parabola through the best three grid points, followed by an exact
+ * linear solve at the refined time.
+ */
+class LinearTemplateFit {
+public:
+  // longest fit window, the samples are kept on the stack
+  static const std::size_t maxFitLength = 256;
+
+  LinearTemplateFit();
+
+  /**
+   * @brief precompute the grid for windows of fitLength samples
+   *
+   * times are searched in [tLow, tHigh] window sample coordinates, with
+   * resolution grid points per sample
+   */
+  LinearTemplateFit(const TabulatedTemplate& tmpl, std::size_t fitLength,
+                    double tLow, double tHigh, std::size_t resolution);
+
+  /**
+   * @brief fit the fitLength samples of window into out
+   *
+   * tmpl must be the template the grid was made from. out holds one pulse
+   * and its chi2 per degree of freedom, converged is false if the chi2
+   * minimum is on the edge of the time grid
+   */
+  void fit(const TabulatedTemplate& tmpl, const UShort_t* window,
+           TemplateFitter::Output& out) const;
+
+  bool empty() const { return templates_.empty(); }
+
+private:
+  double chi2At(std::size_t g, const double* y, double sumY,
+                double sumYY) const;
+
+  std::size_t fitLength_;
+  double tLow_;
+  double step_;
+  std::size_t nGrid_;
+  // grid points per coarse search step
+  std::size_t coarseStride_;
+  // [grid point][sample] template values
+  std::vector<double> templates_;
+  std::vector<double> sumF_;
+  std::vector<double> sumFF_;
+  // 1 / determinant of the normal matrix, 0 if it is singular
+  std::vector<double> invDet_;
+};
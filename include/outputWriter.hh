@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Rtypes.h"
+#include "TTree.h"
+
+#include "fitterStructs.hh"
+#include "pulseProcessing.hh"
+
+/**
+ * @brief fills the output tree on its own thread
+ *
+ * the event loop copies the results of each entry into a batch of
+ * batchEntries rows. Full batches go through a bounded queue of queueDepth
+ * batches to a writer thread that does the TTree::Fill calls and with them
+ * the basket compression. The event loop only waits when every batch is
+ * still queued
+ */
+class outputWriter {
+public:
+  /**
+   * @brief make the output branches of tree for the steps and triggers of
+   * plan, with baskets of basketSize bytes
+   *
+   * the branches point at the writer's own row buffer, not at the pSums.
+   * Branches that already exist in tree, as in a resumed output, are
+   * reconnected instead
+   */
+  outputWriter(TTree& tree, const executionPlan& plan,
+               const std::vector<std::unique_ptr<digitizer>>& digs,
+               Int_t basketSize, std::size_t batchEntries,
+               std::size_t queueDepth);
+  ~outputWriter();
+
+  /**
+   * @brief queue the current pSums and trigger times of plan as one entry
+   */
+  void addEntry();
+
+  /**
+   * @brief wait until every entry added so far has been filled into the
+   * tree, the writer thread is idle until the next addEntry
+   */
+  void flush();
+
+  /**
+   * @brief write out the partial batch and wait for the writer thread,
+   * the tree may be written afterwards
+   */
+  void finish();
+
+private:
+  struct batch {
+    std::vector<pulseSummary> summaries;
+    std::vector<Double_t> triggerTimes;
+    std::size_t nEntries;
+  };
+
+  void submitCurrent(bool waitForFree);
+  void run();
+
+  TTree& tree_;
+  const executionPlan& plan_;
+  const std::size_t batchEntries_;
+
+  // one output row, the branch addresses
+  std::vector<pulseSummary> rowSummaries_;
+  std::vector<Double_t> rowTriggerTimes_;
+
+  std::vector<batch> batches_;
+  std::size_t current_;
+  std::deque<std::size_t> full_;
+  std::deque<std::size_t> free_;
+  // the writer thread is filling a batch
+  bool writing_;
+  bool done_;
+  std::mutex mutex_;
+  std::condition_variable batchFull_;
+  std::condition_variable batchFree_;
+  std::thread writer_;
+};
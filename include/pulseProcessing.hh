@@ -0,0 +1,159 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Rtypes.h"
+#include "TFile.h"
+#include "TTree.h"
+
+#include "fitterStructs.hh"
+#include "traceCache.hh"
+#include "runStatistics.hh"
+
+/**
+ * per event processing for pulse analysis: input handling, the execution
+ * plan and the per trace fits
+ */
+
+/**
+ * input traces come either from the "t" tree of a ROOT file or from a
+ * columnar trace cache made by makeTraceCache
+ */
+struct inputSource {
+  std::string fileName;
+  std::unique_ptr<TFile> file;
+  TTree* tree;
+  // TTreeCache size in bytes for ROOT input, 0 keeps the ROOT default
+  Long64_t treeCacheSize;
+  std::shared_ptr<const TraceCache> cache;
+  // cache branch index of each digitizer
+  std::vector<int> cacheBranches;
+};
+
+/**
+ * one detector to process per event. The trace of entry i starts at
+ * traceBase + i * entryStride: the stride is zero for the daq structs
+ * filled by GetEntry and the trace length for a trace cache column
+ */
+struct planStep {
+  const UShort_t* traceBase;
+  std::size_t entryStride;
+  std::size_t traceLength;
+  detector* det;
+  // trigger time of the detector's group, null without trigger correction
+  const Double_t* triggerTime;
+  // trigger time the search window starts from, null for windows relative
+  // to the trace
+  const Double_t* searchTrigger;
+};
+
+/**
+ * samples of one trace searched for the extremum in the current event
+ */
+struct searchWindow {
+  std::size_t start;
+  std::size_t length;
+  // pulseFlag bits for the window and the extremum found in it
+  UInt_t flags;
+};
+
+/**
+ * one group trigger time to compute per event
+ */
+struct triggerStep {
+  const UShort_t* traceBase;
+  std::size_t entryStride;
+  std::size_t traceLength;
+  Double_t minAmplitude;
+  Double_t* time;
+};
+
+/**
+ * the configuration resolved into flat arrays once the input is connected,
+ * so the event loop needs no string compares or virtual calls
+ */
+struct executionPlan {
+  std::vector<planStep> steps;
+  std::vector<triggerStep> triggers;
+  // per event scratch space for the batched peak search
+  std::vector<estimatorInput> inputs;
+  std::vector<searchWindow> windows;
+  std::vector<quickEstimate> estimates;
+  // time spent in this plan's event loop, peak and fit stages are filled
+  // by processEntry, read and fill by the caller
+  stageCounters counters;
+};
+
+/**
+ * @brief open fileName as input for digs
+ *
+ * for ROOT input the needed branches are enabled and connected to the
+ * digitizer structs and added to a TTreeCache of treeCacheSize bytes, for a
+ * trace cache the digitizer branches are looked up
+ */
+void openInput(const std::string& fileName, inputSource& source,
+               std::vector<std::unique_ptr<digitizer>>& digs,
+               Long64_t treeCacheSize = 0);
+
+/**
+ * @brief open a second view of source for another set of digitizers
+ *
+ * trace caches are shared, ROOT files are reopened
+ */
+void reopenInput(const inputSource& source, inputSource& copy,
+                 std::vector<std::unique_ptr<digitizer>>& digs);
+
+Long64_t getEntries(const inputSource& source);
+
+/**
+ * @brief read entry i of a ROOT input into the digitizer structs, nothing
+ * to do for a trace cache
+ */
+inline void readEntry(inputSource& source, Long64_t i) {
+  if (source.tree) {
+    source.tree->GetEntry(i);
+  }
+}
+
+/**
+ * @brief resolve digs and their input into an execution plan
+ *
+ * the plan points into digs and into the input, both must outlive it
+ */
+void buildPlan(const inputSource& source,
+               std::vector<std::unique_ptr<digitizer>>& digs,
+               executionPlan& plan);
+
+/**
+ * @brief add the fit counters of the detectors in other to those in plan
+ *
+ * both plans must have been built from the same configuration
+ */
+void addFitCounters(executionPlan& plan, const executionPlan& other);
+
+/**
+ * @brief process every step of the plan for entry i, after readEntry
+ *
+ * peak finding is done for all detectors in one batch, each within its
+ * search window. In fast mode only the quick estimators are filled
+ */
+void processEntry(executionPlan& plan, Long64_t i, bool fastMode);
+
+/**
+ * @brief fit one trace, starting from its quick estimate, into det.pSum
+ *
+ * if the fit window around the extremum isn't inside the trace only the
+ * quick estimators are filled and flagFitOutside is set
+ */
+void processTrace(const UShort_t* trace, detector& det, std::size_t len,
+                  const quickEstimate& est);
+
+/**
+ * @brief fill det.pSum from the quick estimators only, without fitting
+ *
+ * the baseline is the mean of the fit window samples before the pulse
+ */
+void processTraceFast(const UShort_t* trace, detector& det, std::size_t len,
+                      const quickEstimate& est);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Rtypes.h"
+
+/**
+ * fast pulse estimators that need no fit: peak search and the parabolic
+ * three sample amplitude and time
+ */
+
+struct estimatorInput {
+  const UShort_t* trace;
+  std::size_t len;
+  Bool_t negPolarity;
+};
+
+struct quickEstimate {
+  std::size_t peakIndex;
+  // three sample amplitude and time, not pedestal subtracted
+  Double_t threeSampleAmpl;
+  Double_t threeSampleTime;
+};
+
+/**
+ * @brief find the extremum of one trace and the parabolic TSA/TST around it
+ *
+ * for negative polarity the extremum is the first minimum, otherwise it is
+ * the first maximum, as with std::min_element/std::max_element
+ */
+quickEstimate estimatePulse(const UShort_t* trace, std::size_t len,
+                            bool negPolarity);
+
+/**
+ * @brief estimate every input trace of an event in one call
+ *
+ * uses AVX2 for the peak search when the cpu supports it
+ */
+void estimatePulses(const estimatorInput* inputs, std::size_t n,
+                    quickEstimate* out);
+
+/**
+ * @brief time of the first half height crossing of a digitized trigger
+ * pulse, linearly interpolated between samples
+ *
+ * the first sample is taken as the trigger baseline, the pulse may have
+ * either polarity. Returns NaN if the trace holds no pulse of at least
+ * minAmplitude counts
+ */
+double estimateTriggerTime(const UShort_t* trigger, std::size_t len,
+                           double minAmplitude);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Rtypes.h"
+
+#include "json11.hpp"
+
+#include "pulseProcessing.hh"
+
+/**
+ * @brief per detector energy and time statistics over the last window
+ * events, for online feedback
+ */
+class rollingSummary {
+public:
+  rollingSummary(const executionPlan& plan, std::size_t window);
+
+  /**
+   * @brief add the current pSums of the plan's detectors
+   */
+  void add();
+
+  /**
+   * @brief mean and rms of energy and time, fitted and converged fractions
+   * for every detector
+   */
+  json11::Json toJson() const;
+
+  /**
+   * @brief write toJson to path, replacing the old file atomically
+   */
+  void publish(const std::string& path) const;
+
+private:
+  struct sample {
+    Double_t energy;
+    Double_t time;
+    bool fitted;
+    bool converged;
+  };
+
+  const executionPlan& plan_;
+  const std::size_t window_;
+  Long64_t nAdded_;
+  // [event % window][step]
+  std::vector<sample> samples_;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "Rtypes.h"
+
+/**
+ * low overhead run instrumentation for pulse analysis: per stage cycle
+ * counters, fit attempt and convergence counters, progress and summary
+ */
+
+class digitizer;
+
+/**
+ * @brief cheap timestamp for stage timing, the TSC where available
+ */
+ULong64_t readCycles();
+
+enum runStage { stageRead, stagePeak, stageFit, stageFill, nRunStages };
+
+/**
+ * cycles spent in each stage of the event loop
+ */
+struct stageCounters {
+  ULong64_t cycles[nRunStages] = {0, 0, 0, 0};
+
+  void add(const stageCounters& other) {
+    for (int i = 0; i < nRunStages; ++i) {
+      cycles[i] += other.cycles[i];
+    }
+  }
+};
+
+/**
+ * per detector fit counters. attempts[i] counts fits accepted on the
+ * (i+1)th fit call, the last bin also counts later calls
+ */
+struct fitCounters {
+  ULong64_t fits = 0;
+  // calls to the fitter, fitCalls / fits is the mean per pulse
+  ULong64_t fitCalls = 0;
+  ULong64_t attempts[3] = {0, 0, 0};
+  // ladder exhausted without an accepted fit
+  ULong64_t rejected = 0;
+  // last fit reported not converged
+  ULong64_t notConverged = 0;
+  // pulses below fitThreshold, not counted in fits
+  ULong64_t skipped = 0;
+  // fit window outside the trace, not counted in fits
+  ULong64_t outside = 0;
+
+  void add(const fitCounters& other) {
+    fits += other.fits;
+    fitCalls += other.fitCalls;
+    for (int i = 0; i < 3; ++i) {
+      attempts[i] += other.attempts[i];
+    }
+    rejected += other.rejected;
+    notConverged += other.notConverged;
+    skipped += other.skipped;
+    outside += other.outside;
+  }
+};
+
+/**
+ * @brief progress line and end of run summary for an event loop
+ *
+ * prints a progress line every progressInterval entries (0 disables it).
+ * An endEntry before firstEntry marks an open ended run
+ */
+class runMonitor {
+public:
+  runMonitor(Long64_t firstEntry, Long64_t endEntry, Long64_t progressInterval);
+
+  /**
+   * @brief call after every processed entry, prints progress if due
+   */
+  void entryDone(Long64_t entry) {
+    ++nEvents_;
+    if ((progressInterval_ > 0) && ((nEvents_ % progressInterval_) == 0)) {
+      printProgress(entry);
+    }
+  }
+
+  Long64_t getNEvents() const { return nEvents_; }
+  double getElapsedSeconds() const;
+
+  /**
+   * @brief multi line summary: events/sec, cycles per event per stage and
+   * fit counters for every detector
+   */
+  std::string summary(const stageCounters& counters,
+                      const std::vector<std::unique_ptr<digitizer>>& digs) const;
+
+private:
+  void printProgress(Long64_t entry) const;
+
+  Long64_t firstEntry_;
+  Long64_t endEntry_;
+  Long64_t progressInterval_;
+  Long64_t nEvents_;
+  std::chrono::steady_clock::time_point start_;
+};
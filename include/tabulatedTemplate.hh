@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <memory>
+
+class TSpline3;
+
+/**
+ * Pulse template sampled once on a uniform grid.
+ *
+ * Values and derivatives are stored in flat arrays, so evaluation is an
+ * index computation plus a cubic Hermite interpolation between neighbouring
+ * grid points instead of the binary search done by TSpline3::Eval.
+ * Like the template used in the fits, the template is zero outside
+ * [tMin, tMax].
+ *
+ * The tables are immutable and shared between copies, so copying a template
+ * is cheap and copies can be evaluated from several threads.
+ */
+class TabulatedTemplate {
+public:
+  TabulatedTemplate();
+
+  /**
+   * @brief sample spline at nPoints uniformly spaced points on [tMin, tMax]
+   */
+  TabulatedTemplate(const TSpline3& spline, double tMin, double tMax,
+                    std::size_t nPoints);
+
+  /**
+   * @brief use nPoints values and derivatives, in units of template value
+   * per grid step, sampled uniformly on [tMin, tMax] in memory kept alive by
+   * storage
+   */
+  TabulatedTemplate(std::shared_ptr<const void> storage, const double* values,
+                    const double* derivs, double tMin, double tMax,
+                    std::size_t nPoints);
+
+  /**
+   * @brief the same tables, but zero outside [tMin, tMax] intersected with
+   * the current range
+   */
+  TabulatedTemplate clipped(double tMin, double tMax) const;
+
+  double eval(double t) const;
+  double derivative(double t) const;
+
+  /**
+   * @brief evaluate template and derivative at t0, t0 + step, ...
+   *
+   * branch free loop over the whole window, meant for the sample times of a
+   * fit window. derivs may be null
+   */
+  void evalWindow(double t0, double step, std::size_t n, double* values,
+                  double* derivs) const;
+
+  double tMin() const { return tMin_; }
+  double tMax() const { return tMax_; }
+  std::size_t size() const { return nPoints_; }
+  bool empty() const { return nPoints_ == 0; }
+
+private:
+  // range outside of which the template is zero
+  double tMin_;
+  double tMax_;
+  // first grid point, tMin_ unless the template was clipped
+  double gridMin_;
+  double step_;
+  double invStep_;
+  std::size_t nPoints_;
+  std::shared_ptr<const void> storage_;
+  const double* values_;
+  // derivatives are stored in units of template value per grid step
+  const double* derivs_;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+
+/**
+ * pieces of the fuzzy template builder shared between digitizers
+ */
+
+struct templateConfig {
+  // from the template config
+  int nBinsPseudoTime;
+  int nTimeBins;
+  int baselineFitLength;
+  int minPeak;
+  bool singlePass;
+  double maxArenaMB;
+  std::string binFitMethod;
+  // also run rootGaus and report the per bin differences to binFitMethod
+  bool checkBinFits;
+  int nThreads;
+
+  // from the detector's entry in the fit config
+  int templateLength;
+  int bufferZone;
+  // the peak is searched for in searchLength samples from searchStart, 0
+  // searches the whole trace
+  int searchStart;
+  int searchLength;
+  int channel;
+  bool negPolarity;
+  std::string digitizerType;
+  std::string branchName;
+};
+
+struct traceSummary {
+  double pseudoTime;
+  int peakIndex;
+  double baseline;
+  double integral;
+  double normalizedAmpl;
+  bool bad;
+};
+
+/**
+ * @brief read the template config and the entry for detectorName in fitConf
+ */
+void readTemplateConfig(const char* fitConf, const char* detectorName,
+                        templateConfig& conf);
+
+/**
+ * @brief find peak, pseudotime, baseline and integral of a trace and, if
+ * correctedTrace isn't null, write the corrected window of good traces to it
+ *
+ * one call does the work of processTrace and correctTrace: the peak search
+ * is estimatePulse's and the baseline and integral are integer sums; the
+ * normalisation of the window is a separate floating point loop
+ */
+traceSummary summarizeTrace(const unsigned short* trace, int traceLength,
+                            const templateConfig& conf,
+                            double* correctedTrace);
+
+/**
+ * @brief summarizeTrace for a Trait digitizer trace
+ */
+template <typename Trait>
+traceSummary processTrace(const unsigned short* trace,
+                          const templateConfig& conf,
+                          double* correctedTrace = nullptr) {
+  return summarizeTrace(trace, Trait::traceLength, conf, correctedTrace);
+}
+
+/**
+ * @brief baseline subtracted, integral normalized templateLength samples
+ * starting bufferZone before the peak
+ */
+void correctTrace(const unsigned short* trace, const traceSummary& summary,
+                  const templateConfig& conf, double* correctedTrace);
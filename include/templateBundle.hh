@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "tabulatedTemplate.hh"
+
+class TSpline3;
+
+/**
+ * Precompiled pulse template.
+ *
+ * A bundle holds the splines of a makeTemplate output file (masterSpline,
+ * errorSpline and realTimeSpline), each sampled on a uniform grid as the
+ * tables of a TabulatedTemplate, together with the spline knots so the
+ * TSpline3s can be rebuilt exactly without ROOT I/O. Bundle files are
+ * memory mapped and never modified, so one bundle is shared by every
+ * detector and thread that uses its template.
+ *
+ * layout: file header, then for every table its values, derivatives, knot
+ * x and knot y, all as doubles
+ */
+
+namespace templateBundle {
+
+const char magic[8] = {'L', '1', 'T', 'M', 'P', 'L', 'B', 'N'};
+const std::uint32_t version = 1;
+
+// tables of a bundle, in file order
+enum table { masterTable, errorTable, realTimeTable, nTables };
+
+struct tableHeader {
+  double tMin;
+  double tMax;
+  // 0 if the template file has no such spline
+  std::uint64_t nPoints;
+  std::uint64_t nKnots;
+};
+
+struct fileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t nTables;
+  tableHeader tables[templateBundle::nTables];
+};
+
+/**
+ * @brief true if path starts with the template bundle magic
+ */
+bool isTemplateBundle(const std::string& path);
+
+/**
+ * @brief sample the splines of the makeTemplate output rootFile at nPoints
+ * points each and write them to a bundle at bundlePath
+ */
+void compile(const std::string& rootFile, const std::string& bundlePath,
+             std::size_t nPoints);
+}
+
+/**
+ * read only view of a template bundle
+ */
+class TemplateBundle {
+public:
+  /**
+   * @brief map the bundle at path, or compile a makeTemplate ROOT file in
+   * memory
+   *
+   * bundles are cached by path, later loads of the same path return the
+   * same bundle for as long as it is in use
+   */
+  static std::shared_ptr<const TemplateBundle> load(const std::string& path);
+
+  bool has(templateBundle::table t) const { return !tables_[t].empty(); }
+
+  /**
+   * @brief sampled spline t, empty if the template file had none
+   */
+  const TabulatedTemplate& get(templateBundle::table t) const {
+    return tables_[t];
+  }
+
+  /**
+   * @brief rebuild spline t from its knots, for code that needs a TSpline3
+   */
+  std::unique_ptr<TSpline3> makeSpline(templateBundle::table t) const;
+
+  const std::string& getPath() const { return path_; }
+
+private:
+  TemplateBundle(const std::string& path, std::shared_ptr<const void> storage,
+                 const char* base, std::size_t size);
+
+  std::string path_;
+  // mapping or in memory copy of the file
+  std::shared_ptr<const void> storage_;
+  const templateBundle::fileHeader* header_;
+  TabulatedTemplate tables_[templateBundle::nTables];
+  const double* knots_[templateBundle::nTables];
+};
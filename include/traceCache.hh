@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "Rtypes.h"
+
+/**
+ * Columnar cache of raw digitizer traces.
+ *
+ * Every cached branch stores each channel as one contiguous column of
+ * nEntries * traceLength samples, so reading a single channel of a run
+ * touches only that channel's pages. The file is memory mapped and traces
+ * are handed out as pointers into the mapping, without copies.
+ *
+ * layout: header, branch table, then the columns of each branch starting
+ * on page boundaries, ordered [channel][entry][sample]. For digitizers with
+ * trigger groups the nTriggers trigger traces follow the channels as extra
+ * columns
+ */
+
+namespace traceCache {
+
+const char magic[8] = {'L', '1', 'T', 'C', 'A', 'C', 'H', 'E'};
+const std::uint32_t version = 2;
+
+struct fileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t nBranches;
+  std::uint64_t nEntries;
+};
+
+struct branchHeader {
+  char name[64];
+  char type[16];
+  std::uint32_t nChannels;
+  std::uint32_t nTriggers;
+  std::uint32_t traceLength;
+  std::uint32_t reserved;
+  std::uint64_t dataOffset;
+};
+
+/**
+ * @brief true if path starts with the trace cache magic
+ */
+bool isTraceCache(const std::string& path);
+
+/**
+ * @brief description of one digitizer branch to put in a cache
+ */
+struct branchSpec {
+  std::string name;
+  std::string type;
+};
+
+/**
+ * @brief copy all channels of the given branches of the "t" tree in
+ * rootFile into a cache file at cachePath
+ */
+void convertTree(const std::string& rootFile, const std::string& cachePath,
+                 const std::vector<branchSpec>& branches);
+}
+
+/**
+ * read only view of a trace cache file
+ */
+class TraceCache {
+public:
+  explicit TraceCache(const std::string& path);
+  ~TraceCache();
+
+  std::size_t getEntries() const { return header_->nEntries; }
+
+  /**
+   * @return index of branch with name branchName, -1 if not cached
+   */
+  int findBranch(const std::string& branchName) const;
+
+  std::size_t getTraceLength(int branch) const {
+    return branches_[branch].traceLength;
+  }
+
+  std::size_t getNChannels(int branch) const {
+    return branches_[branch].nChannels;
+  }
+
+  std::size_t getNTriggers(int branch) const {
+    return branches_[branch].nTriggers;
+  }
+
+  const UShort_t* getTrace(int branch, int channel, std::size_t entry) const {
+    const traceCache::branchHeader& b = branches_[branch];
+    return reinterpret_cast<const UShort_t*>(base_ + b.dataOffset) +
+           (channel * header_->nEntries + entry) * b.traceLength;
+  }
+
+  const UShort_t* getTriggerTrace(int branch, int group,
+                                  std::size_t entry) const {
+    return getTrace(branch, branches_[branch].nChannels + group, entry);
+  }
+
+private:
+  TraceCache(const TraceCache&);
+  TraceCache& operator=(const TraceCache&);
+
+  const char* base_;
+  std::size_t size_;
+  const traceCache::fileHeader* header_;
+  const traceCache::branchHeader* branches_;
+};
@@ -0,0 +1,437 @@
+/*
+  Aaron Fienberg
+  fienberg@uw.edu
+  throughput benchmark for pulse fitting and template building on
+  synthetic digitizer events made from a stored template
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <algorithm>
+
+#include "TFile.h"
+#include "TSpline.h"
+
+#include "json11.hpp"
+
+#include "fitterStructs.hh"
+#include "pulseProcessing.hh"
+#include "digitizerTraits.hh"
+#include "templateBuilder.hh"
+
+using namespace std;
+
+// allocation counting, for checking that the steady state doesn't allocate
+namespace {
+std::atomic<long> nAllocations(0);
+}
+
+void* operator new(std::size_t size) {
+  ++nAllocations;
+  void* p = std::malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+
+namespace {
+
+struct benchConfig {
+  string templateFile;
+  int nEvents;
+  int warmupEvents;
+  unsigned seed;
+  double pedestal;
+  double scale;
+  double scaleJitter;
+  double noise;
+  double pulseSample;
+  double timeJitter;
+  double pileupProbability;
+  double pileupMaxOffset;
+  int nChannels5730;
+  int nChannels1742;
+  fitConfiguration detConf;
+  int baselineFitLength;
+};
+
+struct benchResult {
+  string name;
+  long events;
+  long pulses;
+  double seconds;
+  long allocations;
+  long converged;
+  long fitCalls;
+};
+
+/**
+ * @brief makes synthetic traces: pedestal + scaled template + gaussian
+ * noise, with jittered scale and time and optional pileup
+ */
+class pulseGenerator {
+public:
+  pulseGenerator(const benchConfig& conf, const TabulatedTemplate& tmpl)
+      : conf_(conf), tmpl_(tmpl), rng_(conf.seed), unit_(0, 1) {}
+
+  void fill(UShort_t* trace, std::size_t len) {
+    const double sign = conf_.detConf.negPolarity ? -1 : 1;
+    std::normal_distribution<double> noise(0, conf_.noise);
+    double t0 = conf_.pulseSample + conf_.timeJitter * (2 * unit_(rng_) - 1);
+    double scale = conf_.scale * (1 + conf_.scaleJitter * (2 * unit_(rng_) - 1));
+    bool pileup = unit_(rng_) < conf_.pileupProbability;
+    double t1 = t0 + 1 + (conf_.pileupMaxOffset - 1) * unit_(rng_);
+    double scale1 = scale * unit_(rng_);
+
+    for (std::size_t i = 0; i < len; ++i) {
+      double value = conf_.pedestal + noise(rng_) +
+                     sign * scale * tmpl_.eval(i - t0);
+      if (pileup) {
+        value += sign * scale1 * tmpl_.eval(i - t1);
+      }
+      value = value < 0 ? 0 : (value > 65535 ? 65535 : value);
+      trace[i] = static_cast<UShort_t>(std::lround(value));
+    }
+  }
+
+private:
+  const benchConfig& conf_;
+  const TabulatedTemplate& tmpl_;
+  std::mt19937 rng_;
+  std::uniform_real_distribution<double> unit_;
+};
+
+benchConfig readBenchConfig(const char* confName) {
+  std::stringstream ss;
+  std::ifstream configfile(confName);
+  ss << configfile.rdbuf();
+  configfile.close();
+  std::string err;
+  auto confJson = json11::Json::parse(ss.str(), err);
+  if (err.size() != 0) {
+    std::cerr << "Parsing error for " << confName << " : " << err
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  benchConfig conf;
+  conf.templateFile = confJson["templateFile"].string_value();
+  conf.nEvents = confJson["nEvents"].int_value();
+  conf.warmupEvents = confJson["warmupEvents"].int_value();
+  conf.seed = confJson["seed"].int_value();
+  conf.pedestal = confJson["pedestal"].number_value();
+  conf.scale = confJson["scale"].number_value();
+  conf.scaleJitter = confJson["scaleJitter"].number_value();
+  conf.noise = confJson["noise"].number_value();
+  conf.pulseSample = confJson["pulseSample"].number_value();
+  conf.timeJitter = confJson["timeJitter"].number_value();
+  conf.pileupProbability = confJson["pileupProbability"].number_value();
+  conf.pileupMaxOffset = confJson["pileupMaxOffset"].number_value();
+  conf.nChannels5730 = confJson["nChannels5730"].int_value();
+  conf.nChannels1742 = confJson["nChannels1742"].int_value();
+  if ((conf.nChannels5730 < 0) || (conf.nChannels5730 > CAEN_5730_CH) ||
+      (conf.nChannels1742 < 0) || (conf.nChannels1742 > CAEN_1742_CH)) {
+    std::cerr << "nChannels5730 must be in [0, " << CAEN_5730_CH
+              << "] and nChannels1742 in [0, " << CAEN_1742_CH << "]"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  conf.baselineFitLength = confJson["baselineFitLength"].int_value();
+
+  const auto& det = confJson["detector"];
+  conf.detConf.channel = 0;
+  conf.detConf.templateBuffer = det["templateBuffer"].number_value();
+  conf.detConf.templateLength = det["templateLength"].number_value();
+  conf.detConf.fitLength = det["fitLength"].int_value();
+  conf.detConf.peakIndex = det["peakIndex"].int_value();
+  conf.detConf.wiggleRoom = det["wiggleRoom"].int_value();
+  conf.detConf.fitThreshold = det["fitThreshold"].number_value();
+  conf.detConf.searchStart = det["searchWindow"]["start"].int_value();
+  conf.detConf.searchLength = det["searchWindow"]["length"].int_value();
+  conf.detConf.searchFromTrigger = false;
+  conf.detConf.negPolarity = det["negPolarity"].bool_value();
+  conf.detConf.draw = false;
+  conf.detConf.threeSampleSeed = det["threeSampleSeed"].bool_value();
+  conf.detConf.linearFit = false;
+  conf.detConf.linearFitResolution = det["linearFitResolution"].int_value();
+  return conf;
+}
+
+/**
+ * @brief give dig nChannels identical detectors on channels 0..nChannels-1
+ */
+void addDetectors(digitizer& dig, int nChannels, const benchConfig& conf,
+                  const TSpline3& masterSpline) {
+  dig.detectors.resize(nChannels);
+  for (int ch = 0; ch < nChannels; ++ch) {
+    detector& det = dig.detectors[ch];
+    det.name = dig.type + "_" + std::to_string(ch);
+    det.conf = conf.detConf;
+    det.conf.channel = ch;
+    det.templateSpline.reset((TSpline3*)masterSpline.Clone());
+    setFitterTemplate(det);
+  }
+}
+
+/**
+ * @brief time processEntry on synthetic events for one digitizer
+ */
+benchResult benchDigitizer(digitizer& dig, const benchConfig& conf,
+                           pulseGenerator& gen) {
+  std::vector<std::unique_ptr<digitizer>> digs;
+  digs.emplace_back(&dig);
+  inputSource input;
+  input.tree = nullptr;
+  input.treeCacheSize = 0;
+  executionPlan plan;
+  buildPlan(input, digs, plan);
+
+  benchResult result = {dig.type, 0, 0, 0, 0, 0, 0};
+  long warmupFitCalls = 0;
+  for (int ev = 0; ev < conf.warmupEvents + conf.nEvents; ++ev) {
+    for (auto& det : dig.detectors) {
+      gen.fill(dig.getTrace(det.conf.channel), dig.getTraceLength());
+    }
+
+    long allocsBefore = nAllocations;
+    auto start = std::chrono::steady_clock::now();
+    processEntry(plan, 0, false);
+    auto stop = std::chrono::steady_clock::now();
+    long allocs = nAllocations - allocsBefore;
+
+    if (ev < conf.warmupEvents) {
+      if (ev + 1 == conf.warmupEvents) {
+        for (const auto& det : dig.detectors) {
+          warmupFitCalls += det.fitStats.fitCalls;
+        }
+      }
+      continue;
+    }
+    result.seconds += std::chrono::duration<double>(stop - start).count();
+    result.allocations += allocs;
+    ++result.events;
+    for (const auto& det : dig.detectors) {
+      ++result.pulses;
+      result.converged += det.pSum.fitConverged;
+    }
+  }
+  // fit calls made during the warmup are subtracted
+  for (const auto& det : dig.detectors) {
+    result.fitCalls += det.fitStats.fitCalls;
+  }
+  result.fitCalls -= warmupFitCalls;
+
+  // dig is owned by the caller
+  digs[0].release();
+  return result;
+}
+
+/**
+ * @brief time the template builder's combined trace summary and correction
+ */
+benchResult benchTemplateBuilder(const benchConfig& conf,
+                                 pulseGenerator& gen) {
+  templateConfig tconf;
+  tconf.baselineFitLength = conf.baselineFitLength;
+  tconf.minPeak = conf.pedestal;
+  tconf.templateLength = conf.detConf.templateLength;
+  tconf.bufferZone = conf.detConf.templateBuffer;
+  tconf.searchStart = 0;
+  tconf.searchLength = 0;
+  tconf.channel = 0;
+  tconf.negPolarity = conf.detConf.negPolarity;
+
+  std::vector<UShort_t> trace(caen5730Trait::traceLength);
+  std::vector<double> window(tconf.templateLength);
+  benchResult result = {"templateBuilder", 0, 0, 0, 0, 0, 0};
+  for (int ev = 0; ev < conf.warmupEvents + conf.nEvents; ++ev) {
+    gen.fill(trace.data(), trace.size());
+
+    long allocsBefore = nAllocations;
+    auto start = std::chrono::steady_clock::now();
+    traceSummary summary =
+        processTrace<caen5730Trait>(trace.data(), tconf, window.data());
+    auto stop = std::chrono::steady_clock::now();
+    long allocs = nAllocations - allocsBefore;
+
+    if (ev < conf.warmupEvents) {
+      continue;
+    }
+    result.seconds += std::chrono::duration<double>(stop - start).count();
+    result.allocations += allocs;
+    ++result.events;
+    ++result.pulses;
+    result.converged += !summary.bad;
+  }
+  return result;
+}
+
+/**
+ * @brief fit the same pulses with the iterative and the linear fit and
+ * compare energies and times where both converged
+ */
+json11::Json compareLinearFit(const benchConfig& conf, pulseGenerator& gen,
+                              const TSpline3& masterSpline) {
+  digitizerCaen5730 iterative, linear;
+  addDetectors(iterative, 1, conf, masterSpline);
+  benchConfig linearConf = conf;
+  linearConf.detConf.linearFit = true;
+  addDetectors(linear, 1, linearConf, masterSpline);
+  detector& itDet = iterative.detectors[0];
+  detector& linDet = linear.detectors[0];
+
+  std::vector<UShort_t> trace(caen5730Trait::traceLength);
+  long n = 0;
+  double sumE2 = 0, maxE = 0, sumT2 = 0, maxT = 0;
+  for (int ev = 0; ev < conf.nEvents; ++ev) {
+    gen.fill(trace.data(), trace.size());
+    quickEstimate est = estimatePulse(trace.data(), trace.size(),
+                                      conf.detConf.negPolarity);
+    processTrace(trace.data(), itDet, trace.size(), est);
+    processTrace(trace.data(), linDet, trace.size(), est);
+    if (!(itDet.pSum.fitConverged && linDet.pSum.fitConverged)) {
+      continue;
+    }
+    double dE = linDet.pSum.energy / itDet.pSum.energy - 1;
+    double dT = linDet.pSum.time - itDet.pSum.time;
+    sumE2 += dE * dE;
+    sumT2 += dT * dT;
+    maxE = std::max(maxE, std::abs(dE));
+    maxT = std::max(maxT, std::abs(dT));
+    ++n;
+  }
+  return json11::Json::object{
+      {"name", "linear_vs_iterative"},
+      {"pulses", static_cast<double>(n)},
+      {"energy_rel_rms", n ? std::sqrt(sumE2 / n) : 0},
+      {"energy_rel_max", maxE},
+      {"time_rms", n ? std::sqrt(sumT2 / n) : 0},
+      {"time_max", maxT}};
+}
+
+/**
+ * @brief fit the same pulses and fill their quick estimates, the fitted
+ * and the quick times must agree within a sample
+ *
+ * @param ok set false if any pulse's times differ by a sample or more
+ */
+json11::Json compareFastPath(const benchConfig& conf, pulseGenerator& gen,
+                             const TSpline3& masterSpline, bool& ok) {
+  digitizerCaen5730 dig;
+  addDetectors(dig, 1, conf, masterSpline);
+  detector& det = dig.detectors[0];
+
+  std::vector<UShort_t> trace(caen5730Trait::traceLength);
+  long n = 0;
+  double sumT2 = 0, maxT = 0;
+  for (int ev = 0; ev < conf.nEvents; ++ev) {
+    gen.fill(trace.data(), trace.size());
+    quickEstimate est = estimatePulse(trace.data(), trace.size(),
+                                      conf.detConf.negPolarity);
+    processTrace(trace.data(), det, trace.size(), est);
+    if (!det.pSum.fitConverged) {
+      continue;
+    }
+    const double fitTime = det.pSum.time;
+    processTraceFast(trace.data(), det, trace.size(), est);
+    double dT = fitTime - det.pSum.time;
+    sumT2 += dT * dT;
+    maxT = std::max(maxT, std::abs(dT));
+    ++n;
+  }
+  ok = maxT < 1;
+  return json11::Json::object{
+      {"name", "fit_vs_fast_time"},
+      {"pulses", static_cast<double>(n)},
+      {"time_rms", n ? std::sqrt(sumT2 / n) : 0},
+      {"time_max", maxT},
+      {"ok", ok}};
+}
+
+json11::Json toJson(const benchResult& r) {
+  return json11::Json::object{
+      {"name", r.name},
+      {"events", static_cast<double>(r.events)},
+      {"pulses", static_cast<double>(r.pulses)},
+      {"ns_per_event", r.events ? 1e9 * r.seconds / r.events : 0},
+      {"fits_per_sec", r.seconds > 0 ? r.pulses / r.seconds : 0},
+      {"allocations_per_event",
+       r.events ? static_cast<double>(r.allocations) / r.events : 0},
+      {"convergence_rate",
+       r.pulses ? static_cast<double>(r.converged) / r.pulses : 0},
+      {"fit_calls_per_pulse",
+       r.pulses ? static_cast<double>(r.fitCalls) / r.pulses : 0}};
+}
+}
+
+int main(int argc, char* argv[]) {
+  const char* confName =
+      argc > 1 ? argv[1]
+               : "/home/venanzoni/testBeam/L1Fitting/config/benchConfig.json";
+  benchConfig conf = readBenchConfig(confName);
+
+  std::unique_ptr<TSpline3> masterSpline;
+  {
+    TFile templateFile(conf.templateFile.c_str());
+    masterSpline.reset((TSpline3*)templateFile.Get("masterSpline"));
+  }
+  if (!masterSpline) {
+    cerr << "no masterSpline in " << conf.templateFile << endl;
+    return -1;
+  }
+  TabulatedTemplate tmpl(
+      *masterSpline, -1 * conf.detConf.templateBuffer,
+      conf.detConf.templateLength - conf.detConf.templateBuffer, 10000);
+  pulseGenerator gen(conf, tmpl);
+
+  json11::Json::array results;
+
+  std::unique_ptr<digitizer> caen5730(new digitizerCaen5730);
+  caen5730->type = caen5730Trait::type();
+  addDetectors(*caen5730, conf.nChannels5730, conf, *masterSpline);
+  results.push_back(toJson(benchDigitizer(*caen5730, conf, gen)));
+
+  benchConfig linearConf = conf;
+  linearConf.detConf.linearFit = true;
+  std::unique_ptr<digitizer> linear5730(new digitizerCaen5730);
+  linear5730->type = caen5730Trait::type();
+  addDetectors(*linear5730, conf.nChannels5730, linearConf, *masterSpline);
+  benchResult linearResult = benchDigitizer(*linear5730, conf, gen);
+  linearResult.name = "caen5730_linearFit";
+  results.push_back(toJson(linearResult));
+  results.push_back(compareLinearFit(conf, gen, *masterSpline));
+  bool timesAgree = false;
+  results.push_back(compareFastPath(conf, gen, *masterSpline, timesAgree));
+
+  std::unique_ptr<digitizer> caen1742(new digitizerCaen1742);
+  caen1742->type = caen1742Trait::type();
+  addDetectors(*caen1742, conf.nChannels1742, conf, *masterSpline);
+  results.push_back(toJson(benchDigitizer(*caen1742, conf, gen)));
+
+  results.push_back(toJson(benchTemplateBuilder(conf, gen)));
+
+  cout << json11::Json(json11::Json::object{{"config", confName},
+                                            {"results", results}}).dump()
+       << endl;
+  if (!timesAgree) {
+    cerr << "fitted and quick estimate times differ by a sample or more"
+         << endl;
+    return -1;
+  }
+  return 0;
+}
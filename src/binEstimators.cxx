@@ -0,0 +1,277 @@
+/**
+ * per x bin mean and width estimation for fuzzy templates
+ */
+
+#include "binEstimators.hh"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "TH1.h"
+#include "TH2.h"
+#include "TF1.h"
+
+#include "fuzzyAccumulator.hh"
+
+namespace {
+// rms of a unit gaussian truncated at +- 3 sigma
+const double truncatedRms = 0.986581;
+const int maxIterations = 200;
+
+struct columnStats {
+  double sum;
+  double mean;
+  double rms;
+};
+
+columnStats getStats(const double* counts, int nBins, double yLow,
+                     double width, double lo, double hi) {
+  double sw = 0, swy = 0, swy2 = 0;
+  for (int i = 0; i < nBins; ++i) {
+    double y = yLow + (i + 0.5) * width;
+    if ((y < lo) || (y > hi)) {
+      continue;
+    }
+    sw += counts[i];
+    swy += counts[i] * y;
+    swy2 += counts[i] * y * y;
+  }
+  columnStats stats = {sw, 0, 0};
+  if (sw > 0) {
+    stats.mean = swy / sw;
+    double var = swy2 / sw - stats.mean * stats.mean;
+    stats.rms = var > 0 ? std::sqrt(var) : 0;
+  }
+  return stats;
+}
+
+// solves the symmetric 3x3 system a x = b by cramer's rule
+bool solve3(const double a[3][3], const double b[3], double x[3]) {
+  double det = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+               a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+               a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+  if (det == 0) {
+    return false;
+  }
+  for (int col = 0; col < 3; ++col) {
+    double m[3][3];
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        m[i][j] = j == col ? b[i] : a[i][j];
+      }
+    }
+    x[col] = (m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+              m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+              m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0])) /
+             det;
+  }
+  return true;
+}
+
+double gausChi2(const std::vector<double>& y, const std::vector<double>& n,
+                const double p[3]) {
+  double chi2 = 0;
+  for (std::size_t i = 0; i < y.size(); ++i) {
+    double z = (y[i] - p[1]) / p[2];
+    double r = n[i] - p[0] * std::exp(-0.5 * z * z);
+    chi2 += r * r / n[i];
+  }
+  return chi2;
+}
+}
+
+binEstimate gausFitColumn(const double* counts, int nBins, double yLow,
+                          double width) {
+  columnStats all = getStats(counts, nBins, yLow, width, yLow - width,
+                             yLow + (nBins + 1) * width);
+  const double lo = all.mean - 3 * all.rms;
+  const double hi = all.mean + 3 * all.rms;
+
+  // points that enter the fit
+  std::vector<double> y, n;
+  double maxCount = 0;
+  for (int i = 0; i < nBins; ++i) {
+    double center = yLow + (i + 0.5) * width;
+    if ((counts[i] > 0) && (center >= lo) && (center <= hi)) {
+      y.push_back(center);
+      n.push_back(counts[i]);
+      maxCount = counts[i] > maxCount ? counts[i] : maxCount;
+    }
+  }
+
+  binEstimate fallback = momentsColumn(counts, nBins, yLow, width);
+  if ((y.size() < 4) || (all.rms == 0)) {
+    return fallback;
+  }
+
+  // levenberg-marquardt on amplitude, mean, sigma
+  double p[3] = {maxCount, all.mean, all.rms};
+  double chi2 = gausChi2(y, n, p);
+  double lambda = 1e-3;
+  for (int iter = 0; iter < maxIterations; ++iter) {
+    double jtj[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+    double jtr[3] = {0, 0, 0};
+    for (std::size_t i = 0; i < y.size(); ++i) {
+      double z = (y[i] - p[1]) / p[2];
+      double e = std::exp(-0.5 * z * z);
+      double r = n[i] - p[0] * e;
+      double grad[3] = {e, p[0] * e * z / p[2], p[0] * e * z * z / p[2]};
+      for (int j = 0; j < 3; ++j) {
+        jtr[j] += grad[j] * r / n[i];
+        for (int k = 0; k < 3; ++k) {
+          jtj[j][k] += grad[j] * grad[k] / n[i];
+        }
+      }
+    }
+
+    bool improved = false;
+    while (!improved && (lambda < 1e10)) {
+      double a[3][3];
+      for (int j = 0; j < 3; ++j) {
+        for (int k = 0; k < 3; ++k) {
+          a[j][k] = jtj[j][k] * (j == k ? 1 + lambda : 1);
+        }
+      }
+      double step[3];
+      if (!solve3(a, jtr, step)) {
+        return fallback;
+      }
+      double trial[3] = {p[0] + step[0], p[1] + step[1], p[2] + step[2]};
+      double trialChi2 =
+          trial[2] != 0 ? gausChi2(y, n, trial) : chi2 + 1;
+      if (trialChi2 <= chi2) {
+        improved = true;
+        lambda /= 10;
+        double change = chi2 - trialChi2;
+        std::copy(trial, trial + 3, p);
+        chi2 = trialChi2;
+        if (change <= 1e-10 * (chi2 + 1e-10)) {
+          return {p[1], std::fabs(p[2])};
+        }
+      } else {
+        lambda *= 10;
+      }
+    }
+    if (!improved) {
+      break;
+    }
+  }
+  return {p[1], std::fabs(p[2])};
+}
+
+binEstimate momentsColumn(const double* counts, int nBins, double yLow,
+                          double width) {
+  columnStats all = getStats(counts, nBins, yLow, width, yLow - width,
+                             yLow + (nBins + 1) * width);
+  columnStats core = getStats(counts, nBins, yLow, width,
+                              all.mean - 3 * all.rms, all.mean + 3 * all.rms);
+  if (core.sum == 0) {
+    return {all.mean, all.rms};
+  }
+  return {core.mean, core.rms / truncatedRms};
+}
+
+namespace {
+typedef binEstimate (*columnEstimatorFn)(const double*, int, double, double);
+
+/**
+ * @brief column estimator for method, exits for unknown methods
+ */
+columnEstimatorFn columnEstimator(const std::string& method) {
+  if (method == "gaus") {
+    return gausFitColumn;
+  } else if (method == "moments") {
+    return momentsColumn;
+  }
+  std::cerr << "unknown bin fit method " << method << ". exiting."
+            << std::endl;
+  exit(EXIT_FAILURE);
+}
+}
+
+std::vector<binEstimate> estimateBins(const TH2D& h, const std::string& method,
+                                      int nThreads) {
+  const int nx = h.GetNbinsX();
+  const int ny = h.GetNbinsY();
+  std::vector<binEstimate> estimates(nx);
+
+  if (method == "rootGaus") {
+    for (int i = 0; i < nx; ++i) {
+      std::unique_ptr<TH1D> xBinHist(h.ProjectionY("binhist", i + 1, i + 1));
+      xBinHist->Fit("gaus", "q0", "",
+                    xBinHist->GetMean() - xBinHist->GetRMS() * 3,
+                    xBinHist->GetMean() + xBinHist->GetRMS() * 3);
+      estimates[i].mean = xBinHist->GetFunction("gaus")->GetParameter(1);
+      estimates[i].sigma = xBinHist->GetFunction("gaus")->GetParameter(2);
+    }
+    return estimates;
+  }
+
+  columnEstimatorFn estimator = columnEstimator(method);
+
+  // copy the columns out of the histogram before going parallel, ROOT
+  // objects are only touched from this thread
+  std::vector<double> columns(static_cast<std::size_t>(nx) * ny);
+  for (int i = 0; i < nx; ++i) {
+    for (int j = 0; j < ny; ++j) {
+      columns[static_cast<std::size_t>(i) * ny + j] =
+          h.GetBinContent(i + 1, j + 1);
+    }
+  }
+  TH2D& hist = const_cast<TH2D&>(h);
+  const double yLow = hist.GetYaxis()->GetXmin();
+  const double width = (hist.GetYaxis()->GetXmax() - yLow) / ny;
+
+  nThreads = nThreads < 1 ? 1 : nThreads;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = t; i < nx; i += nThreads) {
+        estimates[i] = estimator(&columns[static_cast<std::size_t>(i) * ny],
+                                 ny, yLow, width);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return estimates;
+}
+
+std::vector<binEstimate> estimateBins(const FuzzyAccumulator& fuzzy,
+                                      const std::string& method,
+                                      int nThreads) {
+  if (method == "rootGaus") {
+    return estimateBins(*fuzzy.makeHist("fuzzyForFits", "fuzzyForFits"),
+                        method, nThreads);
+  }
+
+  columnEstimatorFn estimator = columnEstimator(method);
+  const int nx = fuzzy.getNx();
+  const int ny = fuzzy.getNy();
+  const double yLow = fuzzy.getYLow();
+  const double width = (fuzzy.getYHigh() - yLow) / ny;
+  std::vector<binEstimate> estimates(nx);
+
+  nThreads = nThreads < 1 ? 1 : nThreads;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      std::vector<double> column(ny);
+      for (int i = t; i < nx; i += nThreads) {
+        const std::uint32_t* counts = fuzzy.column(i + 1);
+        for (int j = 0; j < ny; ++j) {
+          column[j] = counts[j];
+        }
+        estimates[i] = estimator(column.data(), ny, yLow, width);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return estimates;
+}
@@ -0,0 +1,78 @@
+/**
+ * checkpoints of a pulse analysis run
+ */
+
+#include "checkpoint.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "json11.hpp"
+
+namespace checkpoint {
+
+std::string pathFor(const std::string& outName) {
+  return outName + ".checkpoint";
+}
+
+bool read(const std::string& path, state& st) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::stringstream ss;
+  ss << file.rdbuf();
+  std::string err;
+  auto json = json11::Json::parse(ss.str(), err);
+  if (err.size() != 0) {
+    std::cerr << "Parsing error for " << path << " : " << err << std::endl;
+    return false;
+  }
+  st.input = json["input"].string_value();
+  st.firstEntry = json["firstEntry"].number_value();
+  st.endEntry = json["endEntry"].number_value();
+  st.nextEntry = json["nextEntry"].number_value();
+  return true;
+}
+
+void write(const std::string& path, const state& st) {
+  json11::Json json = json11::Json::object{
+      {"input", st.input},
+      {"firstEntry", static_cast<double>(st.firstEntry)},
+      {"endEntry", static_cast<double>(st.endEntry)},
+      {"nextEntry", static_cast<double>(st.nextEntry)}};
+
+  const std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream file(tmpPath);
+    file << json.dump() << std::endl;
+    if (!file) {
+      std::cerr << "Error: can't write checkpoint " << tmpPath << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    std::cerr << "Error: can't write checkpoint " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+}
+
+checkpointer::checkpointer(const std::string& outName,
+                           const checkpoint::state& st, Long64_t interval,
+                           outputWriter& writer, TTree& tree)
+    : path_(checkpoint::pathFor(outName)),
+      st_(st),
+      interval_(interval),
+      writer_(writer),
+      tree_(tree) {}
+
+void checkpointer::save(Long64_t nextEntry) {
+  writer_.flush();
+  tree_.AutoSave("SaveSelf");
+  st_.nextEntry = nextEntry;
+  checkpoint::write(path_, st_);
+}
@@ -0,0 +1,121 @@
+/**
+ * background reading of ROOT input entries
+ */
+
+#include "entryPrefetcher.hh"
+
+#include <iostream>
+#include <cstdlib>
+
+#include "TBranch.h"
+#include "TThread.h"
+
+entryPrefetcher::entryPrefetcher(
+    const inputSource& source,
+    const std::vector<std::unique_ptr<digitizer>>& digs, Long64_t firstEntry,
+    Long64_t endEntry, std::size_t depth)
+    : nextRead_(firstEntry),
+      nextHandout_(firstEntry),
+      nextRelease_(firstEntry),
+      endEntry_(endEntry),
+      depth_(depth > 0 ? depth : 1),
+      stop_(false) {
+  TThread::Initialize();
+
+  // the reader gets its own view of the input, all ROOT objects are made
+  // here on the calling thread
+  for (const auto& dig : digs) {
+    readerDigs_.push_back(dig->clone());
+  }
+  reopenInput(source, input_, readerDigs_);
+
+  for (const auto& dig : readerDigs_) {
+    TBranch* branch = input_.tree->GetBranch(dig->branchName.c_str());
+    if (!branch) {
+      std::cerr << "Error: no branch " << dig->branchName << " in "
+                << input_.fileName << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    branches_.push_back(branch);
+    rings_.emplace_back(depth_ * dig->getStructSize());
+  }
+
+  reader_ = std::thread(&entryPrefetcher::run, this);
+}
+
+entryPrefetcher::~entryPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  slotFreed_.notify_one();
+  reader_.join();
+}
+
+void entryPrefetcher::retarget(
+    executionPlan& plan,
+    const std::vector<std::unique_ptr<digitizer>>& digs) const {
+  // a trace in the daq struct of dig sits at the same offset in every slot
+  auto toRing = [&](const UShort_t*& base, std::size_t& stride) {
+    for (std::size_t d = 0; d < digs.size(); ++d) {
+      const char* structBase =
+          reinterpret_cast<const char*>(digs[d]->getStructAddress());
+      const char* trace = reinterpret_cast<const char*>(base);
+      const std::size_t size = digs[d]->getStructSize();
+      if ((trace >= structBase) && (trace < structBase + size)) {
+        base = reinterpret_cast<const UShort_t*>(rings_[d].data() +
+                                                 (trace - structBase));
+        stride = size / sizeof(UShort_t);
+        return;
+      }
+    }
+  };
+  for (auto& step : plan.steps) {
+    toRing(step.traceBase, step.entryStride);
+  }
+  for (auto& trig : plan.triggers) {
+    toRing(trig.traceBase, trig.entryStride);
+  }
+}
+
+void entryPrefetcher::run() {
+  const Long64_t depth = depth_;
+  for (Long64_t entry = nextRead_; entry < endEntry_; ++entry) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      slotFreed_.wait(lock, [&] {
+        return stop_ || (entry - nextRelease_ < depth);
+      });
+      if (stop_) {
+        return;
+      }
+    }
+
+    // decompress straight into the slot
+    const std::size_t slot = entry % depth;
+    for (std::size_t d = 0; d < branches_.size(); ++d) {
+      branches_[d]->SetAddress(rings_[d].data() +
+                               slot * readerDigs_[d]->getStructSize());
+    }
+    readEntry(input_, entry);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      nextRead_ = entry + 1;
+    }
+    slotFilled_.notify_one();
+  }
+}
+
+Long64_t entryPrefetcher::readNext() {
+  Long64_t entry;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // the entry handed out last time is done with
+    nextRelease_ = nextHandout_;
+    slotFreed_.notify_one();
+    slotFilled_.wait(lock, [&] { return nextRead_ > nextHandout_; });
+    entry = nextHandout_++;
+  }
+  return entry % depth_;
+}
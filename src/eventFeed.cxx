@@ -0,0 +1,165 @@
+/**
+ * event sources for online analysis
+ */
+
+#include "eventFeed.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "TTree.h"
+
+namespace {
+// how often a growing file is checked for new entries
+const int refreshPeriodMs = 100;
+
+class growingFileFeed : public eventFeed {
+public:
+  growingFileFeed(inputSource& source) : source_(source), nextEntry_(0) {}
+
+  bool next(int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeoutMs);
+    while (nextEntry_ >= source_.tree->GetEntries()) {
+      if (std::chrono::steady_clock::now() >= deadline) {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(
+          std::min(timeoutMs, refreshPeriodMs)));
+      source_.tree->Refresh();
+    }
+    readEntry(source_, nextEntry_++);
+    return true;
+  }
+
+  Long64_t backlog() { return source_.tree->GetEntries() - nextEntry_; }
+
+  // the daq may always add entries, the caller decides when to stop
+  bool finished() const { return false; }
+
+private:
+  inputSource& source_;
+  Long64_t nextEntry_;
+};
+
+class streamFeed : public eventFeed {
+public:
+  streamFeed(int fd, digitizer& dig)
+      : fd_(fd),
+        event_(reinterpret_cast<char*>(dig.getStructAddress())),
+        eventSize_(dig.getStructSize()),
+        finished_(false) {}
+
+  ~streamFeed() { close(fd_); }
+
+  bool next(int timeoutMs) {
+    // wait only for the start of an event, the rest follows right behind
+    pollfd pfd = {fd_, POLLIN, 0};
+    if (finished_ || (poll(&pfd, 1, timeoutMs) <= 0)) {
+      return false;
+    }
+    std::size_t got = 0;
+    while (got < eventSize_) {
+      ssize_t n = read(fd_, event_ + got, eventSize_ - got);
+      if (n <= 0) {
+        if (got != 0) {
+          std::cerr << "Warning: stream ended inside an event" << std::endl;
+        }
+        finished_ = true;
+        return false;
+      }
+      got += n;
+    }
+    return true;
+  }
+
+  Long64_t backlog() {
+    int nBytes = 0;
+    if (ioctl(fd_, FIONREAD, &nBytes) != 0) {
+      return 0;
+    }
+    return nBytes / eventSize_;
+  }
+
+  bool finished() const { return finished_; }
+
+private:
+  int fd_;
+  char* event_;
+  std::size_t eventSize_;
+  bool finished_;
+};
+}
+
+std::unique_ptr<eventFeed> makeGrowingFileFeed(
+    const std::string& fileName, inputSource& source,
+    std::vector<std::unique_ptr<digitizer>>& digs, Long64_t treeCacheSize) {
+  openInput(fileName, source, digs, treeCacheSize);
+  if (!source.tree) {
+    std::cerr << "Error: can only follow a ROOT file, not " << fileName
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return std::unique_ptr<eventFeed>(new growingFileFeed(source));
+}
+
+std::unique_ptr<eventFeed> makeStreamFeed(
+    const std::string& path, std::vector<std::unique_ptr<digitizer>>& digs) {
+  digitizer* caen5730 = nullptr;
+  for (auto& dig : digs) {
+    if (dig->type == "caen5730") {
+      if (caen5730) {
+        std::cerr << "Error: a stream carries one caen5730 digitizer"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      caen5730 = dig.get();
+    }
+  }
+  if (!caen5730) {
+    std::cerr << "Error: no caen5730 digitizer configured for " << path
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    std::cerr << "Error: " << path << " doesn't exist" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  int fd = -1;
+  if (S_ISSOCK(st.st_mode)) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((fd >= 0) &&
+        (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)) {
+      close(fd);
+      fd = -1;
+    }
+  } else {
+    fd = open(path.c_str(), O_RDONLY);
+  }
+  if (fd < 0) {
+    std::cerr << "Error: can't open stream " << path << " : "
+              << std::strerror(errno) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return std::unique_ptr<eventFeed>(new streamFeed(fd, *caen5730));
+}
@@ -0,0 +1,74 @@
+/**
+ * integer count fuzzy template accumulator
+ */
+
+#include "fuzzyAccumulator.hh"
+
+#include <cassert>
+
+#include "TH2.h"
+
+FuzzyAccumulator::FuzzyAccumulator(int nx, double xLow, double xHigh, int ny,
+                                   double yLow, double yHigh)
+    : nx_(nx),
+      xLow_(xLow),
+      xHigh_(xHigh),
+      ny_(ny),
+      yLow_(yLow),
+      yHigh_(yHigh),
+      counts_(static_cast<std::size_t>(nx + 2) * (ny + 2), 0) {}
+
+void FuzzyAccumulator::fillWindow(const double* values, int n, double x0) {
+  if (index_.size() < static_cast<std::size_t>(n)) {
+    index_.resize(n);
+  }
+  std::uint32_t* index = index_.data();
+  const double nx = nx_;
+  const double ny = ny_;
+  const double xRange = xHigh_ - xLow_;
+  const double yRange = yHigh_ - yLow_;
+  const std::uint32_t stride = ny_ + 2;
+  for (int j = 0; j < n; ++j) {
+    // bin - 1 as in TAxis::FindBin, clamped to -1 for underflow and n for
+    // overflow before the conversion to integer
+    double fx = nx * ((x0 + j) - xLow_) / xRange;
+    fx = fx < 0 ? -1 : (fx < nx ? fx : nx);
+    double fy = ny * (values[j] - yLow_) / yRange;
+    fy = fy < 0 ? -1 : (fy < ny ? fy : ny);
+    index[j] = (1 + static_cast<int>(fx)) * stride + 1 + static_cast<int>(fy);
+  }
+  std::uint32_t* counts = counts_.data();
+  for (int j = 0; j < n; ++j) {
+    ++counts[index[j]];
+  }
+}
+
+void FuzzyAccumulator::add(const FuzzyAccumulator& other) {
+  assert(other.counts_.size() == counts_.size());
+  const std::uint32_t* in = other.counts_.data();
+  std::uint32_t* out = counts_.data();
+  const std::size_t n = counts_.size();
+  for (std::size_t i = 0; i < n; ++i) {
+    out[i] += in[i];
+  }
+}
+
+std::unique_ptr<TH2D> FuzzyAccumulator::makeHist(
+    const std::string& name, const std::string& title) const {
+  std::unique_ptr<TH2D> hist(new TH2D(name.c_str(), title.c_str(), nx_,
+                                      xLow_, xHigh_, ny_, yLow_, yHigh_));
+  double entries = 0;
+  for (int i = 0; i <= nx_ + 1; ++i) {
+    for (int j = 0; j <= ny_ + 1; ++j) {
+      const std::uint32_t count =
+          counts_[static_cast<std::size_t>(i) * (ny_ + 2) + j];
+      if (count) {
+        hist->SetBinContent(i, j, count);
+        entries += count;
+      }
+    }
+  }
+  hist->ResetStats();
+  hist->SetEntries(entries);
+  return hist;
+}
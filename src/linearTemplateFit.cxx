@@ -0,0 +1,154 @@
+/**
+ * non-iterative single pulse template fit
+ */
+
+#include "linearTemplateFit.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <iostream>
+#include <cstdlib>
+
+namespace {
+// the coarse search steps by about a fifth of a sample
+const double coarseStepSamples = 0.2;
+
+/**
+ * @brief least squares scale and pedestal for sum(f*y) = fy and
+ * sum(y) = sy, with n samples
+ */
+inline void linearSolve(double n, double sumF, double sumFF, double invDet,
+                        double fy, double sy, double& scale,
+                        double& pedestal) {
+  scale = (n * fy - sumF * sy) * invDet;
+  pedestal = (sumFF * sy - sumF * fy) * invDet;
+}
+}
+
+const std::size_t LinearTemplateFit::maxFitLength;
+
+LinearTemplateFit::LinearTemplateFit()
+    : fitLength_(0), tLow_(0), step_(1), nGrid_(0), coarseStride_(1) {}
+
+LinearTemplateFit::LinearTemplateFit(const TabulatedTemplate& tmpl,
+                                     std::size_t fitLength, double tLow,
+                                     double tHigh, std::size_t resolution)
+    : fitLength_(fitLength),
+      tLow_(tLow),
+      step_(1.0 / std::max<std::size_t>(resolution, 1)),
+      nGrid_(static_cast<std::size_t>((tHigh - tLow) / step_) + 1),
+      coarseStride_(std::max<std::size_t>(
+          static_cast<std::size_t>(coarseStepSamples / step_), 1)),
+      templates_(nGrid_ * fitLength),
+      sumF_(nGrid_),
+      sumFF_(nGrid_),
+      invDet_(nGrid_) {
+  if (fitLength_ > maxFitLength) {
+    std::cerr << "Error: linear fit windows are limited to " << maxFitLength
+              << " samples" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  const double n = fitLength_;
+  for (std::size_t g = 0; g < nGrid_; ++g) {
+    double* f = &templates_[g * fitLength_];
+    // sample k sees the template at k - t
+    tmpl.evalWindow(-(tLow_ + g * step_), 1.0, fitLength_, f, nullptr);
+    double sumF = 0, sumFF = 0;
+    for (std::size_t k = 0; k < fitLength_; ++k) {
+      sumF += f[k];
+      sumFF += f[k] * f[k];
+    }
+    sumF_[g] = sumF;
+    sumFF_[g] = sumFF;
+    const double det = n * sumFF - sumF * sumF;
+    invDet_[g] = det > 0 ? 1.0 / det : 0;
+  }
+}
+
+double LinearTemplateFit::chi2At(std::size_t g, const double* y, double sumY,
+                                 double sumYY) const {
+  if (invDet_[g] == 0) {
+    return std::numeric_limits<double>::max();
+  }
+  const double* f = &templates_[g * fitLength_];
+  double fy = 0;
+  for (std::size_t k = 0; k < fitLength_; ++k) {
+    fy += f[k] * y[k];
+  }
+  double scale, pedestal;
+  linearSolve(fitLength_, sumF_[g], sumFF_[g], invDet_[g], fy, sumY, scale,
+              pedestal);
+  // residual sum of squares at the least squares solution
+  return sumYY - scale * fy - pedestal * sumY;
+}
+
+void LinearTemplateFit::fit(const TabulatedTemplate& tmpl,
+                            const UShort_t* window,
+                            TemplateFitter::Output& out) const {
+  double y[maxFitLength];
+  const std::size_t n = fitLength_;
+  double sumY = 0, sumYY = 0;
+  for (std::size_t k = 0; k < n; ++k) {
+    y[k] = window[k];
+    sumY += y[k];
+    sumYY += y[k] * y[k];
+  }
+
+  // coarse search, then every grid point around the coarse minimum
+  std::size_t best = 0;
+  double bestChi2 = std::numeric_limits<double>::max();
+  for (std::size_t g = 0; g < nGrid_; g += coarseStride_) {
+    double chi2 = chi2At(g, y, sumY, sumYY);
+    if (chi2 < bestChi2) {
+      bestChi2 = chi2;
+      best = g;
+    }
+  }
+  const std::size_t first = best > coarseStride_ ? best - coarseStride_ : 0;
+  const std::size_t last = std::min(best + coarseStride_, nGrid_ - 1);
+  for (std::size_t g = first; g <= last; ++g) {
+    double chi2 = chi2At(g, y, sumY, sumYY);
+    if (chi2 < bestChi2) {
+      bestChi2 = chi2;
+      best = g;
+    }
+  }
+
+  // parabola through the minimum and its neighbours
+  double t = tLow_ + best * step_;
+  const bool interior = (best > 0) && (best + 1 < nGrid_);
+  if (interior) {
+    double cm = chi2At(best - 1, y, sumY, sumYY);
+    double cp = chi2At(best + 1, y, sumY, sumYY);
+    double curvature = cm + cp - 2 * bestChi2;
+    if (curvature > 0) {
+      t += 0.5 * step_ * (cm - cp) / curvature;
+    }
+  }
+
+  // exact solve at the refined time
+  double f[maxFitLength];
+  tmpl.evalWindow(-t, 1.0, n, f, nullptr);
+  double sumF = 0, sumFF = 0, fy = 0;
+  for (std::size_t k = 0; k < n; ++k) {
+    sumF += f[k];
+    sumFF += f[k] * f[k];
+    fy += f[k] * y[k];
+  }
+  const double det = n * sumFF - sumF * sumF;
+  double scale = 0, pedestal = sumY / n;
+  if (det > 0) {
+    linearSolve(n, sumF, sumFF, 1.0 / det, fy, sumY, scale, pedestal);
+  }
+
+  out.times.resize(1);
+  out.scales.resize(1);
+  out.times[0] = t;
+  out.scales[0] = scale;
+  out.pedestal = pedestal;
+  // per degree of freedom with unit noise, as the iterative fitter reports
+  // it: time, scale and pedestal are fitted
+  out.chi2 = (sumYY - scale * fy - pedestal * sumY) / (n > 3 ? n - 3.0 : 1.0);
+  out.converged = interior && (det > 0);
+}
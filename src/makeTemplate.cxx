@@ -0,0 +1,348 @@
+/*
+  Aaron Fienberg
+  fienberg@uw.edu
+  code for generating "fuzzy templates" based on digitized datasets
+*/
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <functional>
+
+#include "TSystem.h"
+#include "TTree.h"
+#include "TGraphErrors.h"
+#include "TFile.h"
+#include "TSpline.h"
+#include "TH1.h"
+#include "TF1.h"
+#include "TH2.h"
+#include "TString.h"
+#include "TThread.h"
+
+#include "digitizerTraits.hh"
+#include "templateBuilder.hh"
+#include "binEstimators.hh"
+#include "fuzzyAccumulator.hh"
+#include "traceCache.hh"
+
+using namespace std;
+
+/**
+ * @brief reads the traces of one channel, from the daq ROOT file or a trace
+ * cache. Every worker thread has its own reader
+ */
+template <typename Trait>
+struct traceReader {
+  const TraceCache* cache;
+  int cacheBranch;
+  int channel;
+  unique_ptr<TFile> file;
+  TTree* t;
+  unique_ptr<typename Trait::event> c;
+
+  const unsigned short* get(int entry) {
+    if (cache) {
+      return cache->getTrace(cacheBranch, channel, entry);
+    }
+    t->GetEntry(entry);
+    return Trait::trace(*c, channel);
+  }
+};
+
+/**
+ * @brief corrected windows kept in memory by one worker in single pass mode
+ */
+struct windowArena {
+  vector<double> windows;
+  size_t nWindows;
+  size_t maxWindows;
+};
+
+/**
+ * @brief build the template of one detector of a Trait digitizer
+ */
+template <typename Trait>
+int buildTemplate(const char* inFileName, const char* outFileName,
+                  const templateConfig& conf);
+
+int main(int argc, char* argv[]) {
+  if (argc < 4) {
+    cout << "usage: ./makeTemplate <inputfile> <outputfile> <detectorName> "
+            "[fitter config]" << endl;
+    return -1;
+  }
+
+  templateConfig conf;
+  if (argc == 4) {
+    readTemplateConfig(
+        "/home/venanzoni/testBeam/L1Fitting/config/defaultFitConfig.json",
+        argv[3], conf);
+  } else {
+    readTemplateConfig(argv[4], argv[3], conf);
+  }
+
+  if (conf.digitizerType == caen5730Trait::type()) {
+    return buildTemplate<caen5730Trait>(argv[1], argv[2], conf);
+  } else if (conf.digitizerType == caen1742Trait::type()) {
+    return buildTemplate<caen1742Trait>(argv[1], argv[2], conf);
+  }
+
+  cerr << "unknown digitizer type " << conf.digitizerType << ". exiting."
+       << endl;
+  return -1;
+}
+
+template <typename Trait>
+int buildTemplate(const char* inFileName, const char* outFileName,
+                  const templateConfig& conf) {
+  const int templateLength = conf.templateLength;
+  const int nTimeBins = conf.nTimeBins;
+  const int nBinsPseudoTime = conf.nBinsPseudoTime;
+  const int bufferZone = conf.bufferZone;
+  const int channel = conf.channel;
+
+  // read input file, either the daq ROOT file or a trace cache
+  gSystem->Load("libTree");
+  unique_ptr<TraceCache> cache;
+  int cacheBranch = -1;
+  unique_ptr<TFile> infile;
+  if (traceCache::isTraceCache(inFileName)) {
+    cache.reset(new TraceCache(inFileName));
+    cacheBranch = cache->findBranch(conf.branchName);
+    if (cacheBranch < 0) {
+      cerr << conf.branchName << " not in trace cache " << inFileName << endl;
+      return -1;
+    }
+  } else {
+    infile.reset(new TFile(inFileName));
+  }
+  const int nEntries =
+      cache ? cache->getEntries() : ((TTree*)infile->Get("t"))->GetEntries();
+
+  // each worker handles one contiguous range of entries in both passes.
+  // ROOT readers are made here, before any worker starts
+  const int nWorkers = max(1, min(conf.nThreads, nEntries));
+  vector<int> rangeStart(nWorkers + 1);
+  for (int w = 0; w <= nWorkers; ++w) {
+    rangeStart[w] = static_cast<long>(nEntries) * w / nWorkers;
+  }
+  if (!cache && (nWorkers > 1)) {
+    TThread::Initialize();
+  }
+  vector<traceReader<Trait>> readers(nWorkers);
+  for (int w = 0; w < nWorkers; ++w) {
+    traceReader<Trait>& reader = readers[w];
+    reader.cache = cache.get();
+    reader.cacheBranch = cacheBranch;
+    reader.channel = channel;
+    reader.t = nullptr;
+    if (!cache) {
+      reader.file.reset(w == 0 ? infile.release() : new TFile(inFileName));
+      reader.t = (TTree*)reader.file->Get("t");
+      reader.c.reset(new typename Trait::event);
+      reader.t->SetBranchAddress(conf.branchName.c_str(),
+                                 Trait::branchAddress(*reader.c));
+    }
+  }
+  auto runWorkers = [&](const function<void(int)>& work) {
+    vector<thread> workers;
+    for (int w = 1; w < nWorkers; ++w) {
+      workers.emplace_back(work, w);
+    }
+    work(0);
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  };
+
+  // process traces
+  vector<traceSummary> summaries(nEntries);
+
+  // in single pass mode the corrected windows of good traces are kept in
+  // memory, up to maxArenaMB split evenly between the workers, so they
+  // don't have to be read a second time. arenaSlot[i] is the window index
+  // of entry i in its worker's arena, -1 if it must be reread
+  vector<windowArena> arenas(nWorkers);
+  vector<int> arenaSlot(nEntries, -1);
+  const size_t maxArenaWindows =
+      conf.singlePass
+          ? conf.maxArenaMB * 1024 * 1024 / (templateLength * sizeof(double))
+          : 0;
+  for (int w = 0; w < nWorkers; ++w) {
+    arenas[w].nWindows = 0;
+    arenas[w].maxWindows = maxArenaWindows / nWorkers;
+  }
+  runWorkers([&](int w) {
+    windowArena& arena = arenas[w];
+    for (int i = rangeStart[w]; i < rangeStart[w + 1]; ++i) {
+      // the window goes straight into the next arena slot, which is kept
+      // if the trace is good
+      double* slot = nullptr;
+      if (arena.nWindows < arena.maxWindows) {
+        if (arena.windows.size() < (arena.nWindows + 1) * templateLength) {
+          arena.windows.resize(
+              min(2 * arena.nWindows + 1, arena.maxWindows) * templateLength);
+        }
+        slot = &arena.windows[arena.nWindows * templateLength];
+      }
+      summaries[i] = processTrace<Trait>(readers[w].get(i), conf, slot);
+      if (slot && (!summaries[i].bad)) {
+        arenaSlot[i] = arena.nWindows++;
+      }
+    }
+  });
+
+  if (conf.singlePass) {
+    int nReread = 0;
+    for (int i = 0; i < nEntries; ++i) {
+      nReread += (!summaries[i].bad) && (arenaSlot[i] < 0);
+    }
+    if (nReread > 0) {
+      cout << "the arena of " << conf.maxArenaMB << " MB holds "
+           << maxArenaWindows << " windows, " << nReread
+           << " good traces are read a second time" << endl;
+    }
+  }
+
+  // filled in entry order so the automatic binning of the maxes and
+  // integrals is the same as for a serial pass
+  TH1D pseudoTimesHist("ptimes", "ptimes", nBinsPseudoTime, 0, 1);
+  TH1D normalizedMaxes("maxes", "maxes", 100, 0.0, 0.0);
+  TH1D integralHist("integrals", "integrals", 100, 0.0, 0.0);
+  for (int i = 0; i < nEntries; ++i) {
+    pseudoTimesHist.Fill(summaries[i].pseudoTime);
+    normalizedMaxes.Fill(summaries[i].normalizedAmpl);
+    integralHist.Fill(summaries[i].integral);
+  }
+  pseudoTimesHist.Scale(1.0 / pseudoTimesHist.Integral());
+
+  // find max for fuzzy template bin range
+  normalizedMaxes.Fit("gaus", "q0");
+  double binRangeMax = normalizedMaxes.GetFunction("gaus")->GetParameter(1) +
+                       5 * normalizedMaxes.GetFunction("gaus")->GetParameter(2);
+
+  // create map to real time
+  TGraph realTimes(0);
+  realTimes.SetName("realTimeGraph");
+  realTimes.SetPoint(0, 0, 0);
+  for (int i = 0; i < nBinsPseudoTime; ++i) {
+    realTimes.SetPoint(i, pseudoTimesHist.GetBinLowEdge(i + 2),
+                       pseudoTimesHist.Integral(1, i + 1));
+  }
+  TSpline3 rtSpline = TSpline3("realTimeSpline", &realTimes);
+  rtSpline.SetName("realTimeSpline");
+
+  // fill the timeslices and make the master fuzzy template. Every worker
+  // fills its own accumulator, added to the first in worker order. The bins
+  // hold counts, so the sum doesn't depend on the split
+  vector<FuzzyAccumulator> fuzzyParts(
+      nWorkers, FuzzyAccumulator(templateLength * nTimeBins, -.5 - bufferZone,
+                                 templateLength - .5 - bufferZone, 1000,
+                                 -.2 * binRangeMax, binRangeMax));
+
+  runWorkers([&](int w) {
+    FuzzyAccumulator& fuzzy = fuzzyParts[w];
+    const vector<double>& arena = arenas[w].windows;
+    vector<double> window(templateLength);
+    for (int i = rangeStart[w]; i < rangeStart[w + 1]; ++i) {
+      if (summaries[i].bad) {
+        continue;
+      }
+      double realTime = rtSpline.Eval(summaries[i].pseudoTime);
+      const double* ctrace = window.data();
+      if (arenaSlot[i] >= 0) {
+        ctrace = &arena[arenaSlot[i] * templateLength];
+      } else {
+        correctTrace(readers[w].get(i), summaries[i], conf, window.data());
+      }
+      fuzzy.fillWindow(ctrace, templateLength, 0.5 - bufferZone - realTime);
+    }
+  });
+  FuzzyAccumulator& masterFuzzy = fuzzyParts[0];
+  for (int w = 1; w < nWorkers; ++w) {
+    masterFuzzy.add(fuzzyParts[w]);
+  }
+
+  // step through fuzzy template to get errors and means
+  TGraphErrors masterGraph(0);
+  masterGraph.SetName("masterGraph");
+  TGraph errorGraph(0);
+  errorGraph.SetName("errorGraph");
+  TGraph errorVsMean(0);
+  errorVsMean.SetName("errorVsMean");
+  auto binEstimates =
+      estimateBins(masterFuzzy, conf.binFitMethod, conf.nThreads);
+  for (int i = 0; i < templateLength * nTimeBins; ++i) {
+    double mean = binEstimates[i].mean;
+    double sig = binEstimates[i].sigma;
+    errorGraph.SetPoint(i, static_cast<double>(i) / nTimeBins - bufferZone - .5,
+                        sig);
+    masterGraph.SetPoint(
+        i, static_cast<double>(i) / nTimeBins - bufferZone - .5, mean);
+    masterGraph.SetPointError(i, 0, sig);
+    errorVsMean.SetPoint(i, mean, sig);
+  }
+
+  // per bin differences to the serial ROOT fits, to validate the faster
+  // estimators
+  TGraph meanDiffGraph(0);
+  meanDiffGraph.SetName("binFitMeanDiff");
+  TGraph sigmaDiffGraph(0);
+  sigmaDiffGraph.SetName("binFitSigmaDiff");
+  const bool checkBinFits =
+      conf.checkBinFits && (conf.binFitMethod != "rootGaus");
+  if (checkBinFits) {
+    auto reference = estimateBins(masterFuzzy, "rootGaus", 1);
+    double maxMeanPull = 0, sumMeanPull2 = 0, maxSigmaRel = 0;
+    int nCompared = 0;
+    for (int i = 0; i < templateLength * nTimeBins; ++i) {
+      double x = static_cast<double>(i) / nTimeBins - bufferZone - .5;
+      double dMean = binEstimates[i].mean - reference[i].mean;
+      double dSigma = binEstimates[i].sigma - reference[i].sigma;
+      meanDiffGraph.SetPoint(i, x, dMean);
+      sigmaDiffGraph.SetPoint(i, x, dSigma);
+      if (reference[i].sigma > 0) {
+        double pull = fabs(dMean) / reference[i].sigma;
+        maxMeanPull = max(maxMeanPull, pull);
+        sumMeanPull2 += pull * pull;
+        maxSigmaRel = max(maxSigmaRel, fabs(dSigma) / reference[i].sigma);
+        ++nCompared;
+      }
+    }
+    cout << conf.binFitMethod << " vs rootGaus over " << nCompared
+         << " bins: mean difference / sigma max " << maxMeanPull << " rms "
+         << (nCompared ? sqrt(sumMeanPull2 / nCompared) : 0)
+         << ", relative sigma difference max " << maxSigmaRel << endl;
+  }
+
+  TSpline3 masterSpline("masterSpline", &masterGraph);
+  masterSpline.SetName("masterSpline");
+  masterSpline.SetNpx(10000);
+  TSpline3 errorSpline("errorSpline", &errorGraph);
+  errorSpline.SetName("errorSpline");
+  errorSpline.SetNpx(10000);
+
+  // save data
+  TFile outf(outFileName, "recreate");
+  rtSpline.Write();
+  pseudoTimesHist.Write();
+  masterFuzzy.makeHist("masterFuzzy", "Fuzzy Template")->Write();
+  errorGraph.Write();
+  masterGraph.Write();
+  masterSpline.Write();
+  errorSpline.Write();
+  errorVsMean.Write();
+  if (checkBinFits) {
+    meanDiffGraph.Write();
+    sigmaDiffGraph.Write();
+  }
+  outf.Write();
+  outf.Close();
+
+  return 0;
+}
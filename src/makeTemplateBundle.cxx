@@ -0,0 +1,37 @@
+/*
+  Aaron Fienberg
+  fienberg@uw.edu
+  compiles a makeTemplate output file into a memory mappable template
+  bundle, so pulseAnalysis doesn't read template ROOT files. The sampled
+  tables serve the linear fit, the TemplateFitter still samples its own
+  copy of the spline rebuilt from the bundle's knots
+*/
+
+#include <iostream>
+#include <cstdlib>
+
+#include "templateBundle.hh"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    cout << "usage: ./makeTemplateBundle <templatefile> <outputfile> "
+            "[points per table]" << endl;
+    return -1;
+  }
+
+  long long nPoints = 10000;
+  if (argc > 3) {
+    char* end;
+    nPoints = strtoll(argv[3], &end, 10);
+    // 1e8 points are 1.6 GB per table
+    if ((*end != '\0') || (nPoints < 2) || (nPoints > 100000000)) {
+      cerr << "points per table must be an integer in [2, 100000000], got "
+           << argv[3] << endl;
+      return -1;
+    }
+  }
+  templateBundle::compile(argv[1], argv[2], nPoints);
+  return 0;
+}
@@ -0,0 +1,59 @@
+/*
+  Aaron Fienberg
+  fienberg@uw.edu
+  converts the digitizer branches of a daq ROOT file into a columnar,
+  memory mappable trace cache that pulseAnalysis and the template builders
+  can read in place of the ROOT file
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <vector>
+#include <string>
+
+#include "json11.hpp"
+
+#include "traceCache.hh"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    cout << "usage: ./makeTraceCache <inputfile> <outputfile> [fitter config]"
+         << endl;
+    return -1;
+  }
+
+  const char* confName =
+      argc > 3
+          ? argv[3]
+          : "/home/venanzoni/testBeam/L1Fitting/config/defaultFitConfig.json";
+  std::stringstream ss;
+  std::ifstream configfile(confName);
+  ss << configfile.rdbuf();
+  configfile.close();
+  std::string err;
+  auto confJson = json11::Json::parse(ss.str(), err);
+  if (err.size() != 0) {
+    std::cerr << "Parsing error for " << confName << " : " << err
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // cache every digitizer that has detectors configured
+  vector<traceCache::branchSpec> branches;
+  for (const auto& digEntry : confJson["digitizers"].array_items()) {
+    if (digEntry["detectors"].array_items().size() == 0) {
+      continue;
+    }
+    traceCache::branchSpec spec;
+    spec.name = digEntry["branchName"].string_value();
+    spec.type = digEntry["type"].string_value();
+    branches.push_back(spec);
+  }
+
+  traceCache::convertTree(argv[1], argv[2], branches);
+  return 0;
+}
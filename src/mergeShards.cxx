@@ -0,0 +1,123 @@
+/*
+  Aaron Fienberg
+  fienberg@uw.edu
+  joins the outputs of pulseAnalysis shards into one file, in entry order
+*/
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TChain.h"
+#include "TParameter.h"
+#include "TNamed.h"
+
+using namespace std;
+
+namespace {
+struct shard {
+  string fileName;
+  Long64_t firstEntry;
+  Long64_t endEntry;
+  // input file the shard was cut from and its number of entries
+  string input;
+  Long64_t inputEntries;
+};
+
+/**
+ * @brief read the entry range of a shard output and check it is complete
+ */
+shard readShard(const string& fileName) {
+  unique_ptr<TFile> file(TFile::Open(fileName.c_str()));
+  if ((!file) || file->IsZombie()) {
+    cerr << "Error: can't open " << fileName << endl;
+    exit(EXIT_FAILURE);
+  }
+  auto first = (TParameter<Long64_t>*)file->Get("firstEntry");
+  auto end = (TParameter<Long64_t>*)file->Get("endEntry");
+  auto input = (TNamed*)file->Get("input");
+  auto inputEntries = (TParameter<Long64_t>*)file->Get("inputEntries");
+  auto tree = (TTree*)file->Get("t");
+  if ((!first) || (!end) || (!tree)) {
+    cerr << "Error: " << fileName << " is not a pulseAnalysis output"
+         << endl;
+    exit(EXIT_FAILURE);
+  }
+  if ((!input) || (!inputEntries)) {
+    cerr << "Error: " << fileName << " doesn't record its input, rerun it"
+         << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  shard s = {fileName, first->GetVal(), end->GetVal(), input->GetTitle(),
+             inputEntries->GetVal()};
+  if (tree->GetEntries() != s.endEntry - s.firstEntry) {
+    cerr << "Error: " << fileName << " holds " << tree->GetEntries()
+         << " entries of its range [" << s.firstEntry << ", " << s.endEntry
+         << "), resume it first" << endl;
+    exit(EXIT_FAILURE);
+  }
+  return s;
+}
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    cout << "usage: ./mergeShards <outputfile> <shard> [shard ...]" << endl;
+    return -1;
+  }
+
+  vector<shard> shards;
+  for (int i = 2; i < argc; ++i) {
+    shards.push_back(readShard(argv[i]));
+  }
+  sort(shards.begin(), shards.end(), [](const shard& a, const shard& b) {
+    return a.firstEntry < b.firstEntry;
+  });
+
+  for (size_t i = 1; i < shards.size(); ++i) {
+    if ((shards[i].input != shards[0].input) ||
+        (shards[i].inputEntries != shards[0].inputEntries)) {
+      cerr << "Error: " << shards[0].fileName << " and "
+           << shards[i].fileName << " were cut from different inputs ("
+           << shards[0].input << ", " << shards[0].inputEntries
+           << " entries vs " << shards[i].input << ", "
+           << shards[i].inputEntries << " entries)" << endl;
+      return -1;
+    }
+    if (shards[i].firstEntry != shards[i - 1].endEntry) {
+      cerr << "Error: shards " << shards[i - 1].fileName << " and "
+           << shards[i].fileName << " are not contiguous ("
+           << shards[i - 1].endEntry << " vs " << shards[i].firstEntry << ")"
+           << endl;
+      return -1;
+    }
+  }
+
+  TChain chain("t");
+  for (const auto& s : shards) {
+    chain.Add(s.fileName.c_str());
+  }
+  TFile outf(argv[1], "recreate");
+  // Merge returns the number of files written, 0 on failure
+  if (outf.IsZombie() || (chain.Merge(&outf, 0, "keep") <= 0)) {
+    cerr << "Error: merging the shards into " << argv[1] << " failed" << endl;
+    return -1;
+  }
+  outf.cd();
+  TParameter<Long64_t>("firstEntry", shards.front().firstEntry).Write();
+  TParameter<Long64_t>("endEntry", shards.back().endEntry).Write();
+  TNamed("input", shards.front().input.c_str()).Write();
+  TParameter<Long64_t>("inputEntries", shards.front().inputEntries).Write();
+  outf.Close();
+
+  cout << "merged " << shards.size() << " shards, entries ["
+       << shards.front().firstEntry << ", " << shards.back().endEntry << ")"
+       << endl;
+  return 0;
+}
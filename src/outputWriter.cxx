@@ -0,0 +1,157 @@
+/**
+ * output tree filling on a writer thread
+ */
+
+#include "outputWriter.hh"
+
+#include <algorithm>
+#include <string>
+
+#include "TThread.h"
+
+outputWriter::outputWriter(TTree& tree, const executionPlan& plan,
+                           const std::vector<std::unique_ptr<digitizer>>& digs,
+                           Int_t basketSize, std::size_t batchEntries,
+                           std::size_t queueDepth)
+    : tree_(tree),
+      plan_(plan),
+      batchEntries_(std::max<std::size_t>(batchEntries, 1)),
+      rowSummaries_(plan.steps.size()),
+      rowTriggerTimes_(plan.triggers.size()),
+      batches_(std::max<std::size_t>(queueDepth, 1) + 1),
+      current_(0),
+      writing_(false),
+      done_(false) {
+  TThread::Initialize();
+
+  // the plan holds the steps and triggers in digitizer order
+  std::size_t step = 0;
+  std::size_t trigger = 0;
+  for (const auto& dig : digs) {
+    for (const auto& det : dig->detectors) {
+      void* address = &rowSummaries_[step++].energy;
+      if (tree_.GetBranch(det.name.c_str())) {
+        tree_.SetBranchAddress(det.name.c_str(), address);
+      } else {
+        tree_.Branch(det.name.c_str(), address,
+                     "energy/D:baseline/D:threeSampleAmpl/D:time/D:"
+                     "threeSampleTime/D:chi2/D:flags/i:fitConverged/O:"
+                     "fitted/O",
+                     basketSize);
+      }
+    }
+    if (dig->needsTriggerTimes()) {
+      const std::string name = dig->branchName + "_triggerTimes";
+      void* address = &rowTriggerTimes_[trigger];
+      if (tree_.GetBranch(name.c_str())) {
+        tree_.SetBranchAddress(name.c_str(), address);
+      } else {
+        tree_.Branch(name.c_str(), address,
+                     ("triggerTimes[" +
+                      std::to_string(dig->triggerTimes.size()) + "]/D")
+                         .c_str(),
+                     basketSize);
+      }
+      trigger += dig->triggerTimes.size();
+    }
+  }
+
+  for (std::size_t i = 0; i < batches_.size(); ++i) {
+    batches_[i].summaries.reserve(batchEntries_ * rowSummaries_.size());
+    batches_[i].triggerTimes.reserve(batchEntries_ * rowTriggerTimes_.size());
+    batches_[i].nEntries = 0;
+    if (i != current_) {
+      free_.push_back(i);
+    }
+  }
+
+  writer_ = std::thread(&outputWriter::run, this);
+}
+
+outputWriter::~outputWriter() { finish(); }
+
+void outputWriter::addEntry() {
+  batch& b = batches_[current_];
+  for (const auto& step : plan_.steps) {
+    b.summaries.push_back(step.det->pSum);
+  }
+  for (const auto& trig : plan_.triggers) {
+    b.triggerTimes.push_back(*trig.time);
+  }
+  if (++b.nEntries == batchEntries_) {
+    submitCurrent(true);
+  }
+}
+
+void outputWriter::submitCurrent(bool waitForFree) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  full_.push_back(current_);
+  batchFull_.notify_one();
+  if (waitForFree) {
+    batchFree_.wait(lock, [this] { return !free_.empty(); });
+    current_ = free_.front();
+    free_.pop_front();
+  }
+}
+
+void outputWriter::flush() {
+  if (batches_[current_].nEntries > 0) {
+    submitCurrent(true);
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  batchFree_.wait(lock, [this] { return full_.empty() && !writing_; });
+}
+
+void outputWriter::finish() {
+  if (!writer_.joinable()) {
+    return;
+  }
+  if (batches_[current_].nEntries > 0) {
+    submitCurrent(false);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  batchFull_.notify_one();
+  writer_.join();
+}
+
+void outputWriter::run() {
+  const std::size_t nSummaries = rowSummaries_.size();
+  const std::size_t nTriggers = rowTriggerTimes_.size();
+  while (true) {
+    std::size_t next;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      batchFull_.wait(lock, [this] { return done_ || !full_.empty(); });
+      if (full_.empty()) {
+        return;
+      }
+      next = full_.front();
+      full_.pop_front();
+      writing_ = true;
+    }
+
+    batch& b = batches_[next];
+    for (std::size_t i = 0; i < b.nEntries; ++i) {
+      std::copy(b.summaries.begin() + i * nSummaries,
+                b.summaries.begin() + (i + 1) * nSummaries,
+                rowSummaries_.begin());
+      std::copy(b.triggerTimes.begin() + i * nTriggers,
+                b.triggerTimes.begin() + (i + 1) * nTriggers,
+                rowTriggerTimes_.begin());
+      tree_.Fill();
+    }
+    b.summaries.clear();
+    b.triggerTimes.clear();
+    b.nEntries = 0;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(next);
+      writing_ = false;
+    }
+    batchFree_.notify_one();
+  }
+}
@@ -12,17 +12,33 @@
 #include <algorithm>
 #include <cstdlib>
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <sys/stat.h>
-#include <cassert>
+#include <glob.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <cstdio>
 
 // ROOT includes
 #include "TFile.h"
 #include "TTree.h"
+#include "TThread.h"
+#include "TNamed.h"
+#include "TChain.h"
+#include "TParameter.h"
 
 // project includes
 #include "fitterStructs.hh"
+#include "pulseProcessing.hh"
+#include "runStatistics.hh"
+#include "entryPrefetcher.hh"
+#include "outputWriter.hh"
+#include "checkpoint.hh"
+#include "eventFeed.hh"
+#include "rollingSummary.hh"
 #include "json11.hpp"
 
 /**
@@ -36,6 +52,14 @@ bool exists(const std::string& name) {
   return (stat(name.c_str(), &buffer) == 0);
 }
 
+/**
+ * @brief file name without directory and extension
+ */
+std::string stripExtension(const std::string& path) {
+  std::string name = path.substr(path.find_last_of('/') + 1);
+  return name.substr(0, name.find_last_of('.'));
+}
+
 /**
  * @brief parse config file, build collection of fitConfigurations/
  * also construct TApplication if any drawing is to happen
@@ -43,136 +67,711 @@ bool exists(const std::string& name) {
 json11::Json parseConfig(const std::string& confFileName,
                          std::vector<std::unique_ptr<digitizer>>& digs);
 
+namespace {
+// entries handed to each worker thread per round
+const int entriesPerBlock = 512;
+// file workers make and delete their ROOT objects one at a time, only the
+// event loops run concurrently
+std::mutex rootObjectMutex;
+}
+
+/**
+ * command line settings shared by every input file of a run
+ */
+struct runOptions {
+  int nThreads;
+  bool fastMode;
+  // entry range, a negative end runs to the end of the input
+  Long64_t startEntry;
+  Long64_t endEntry;
+  // analyze part shardIndex of nShards equal parts of the entry range
+  int shardIndex;
+  int nShards;
+  // continue an interrupted output from its checkpoint
+  bool resume;
+};
+
+/**
+ * @brief fit entries [startEntry, endEntry) on nThreads worker threads
+ *
+ * every worker gets its own view of the input and its own clones of the
+ * digitizers and detectors. Results are copied back into the pSums of
+ * digs and handed to writer in entry order, so the output is identical
+ * to a serial run. The workers' stage and fit counters are added to plan's
+ */
+void runThreaded(const inputSource& source,
+                 std::vector<std::unique_ptr<digitizer>>& digs,
+                 executionPlan& plan, outputWriter& writer,
+                 Long64_t startEntry, Long64_t endEntry, int nThreads,
+                 bool fastMode,
+                 runMonitor& monitor, checkpointer& checkpoints);
+
 /**
- * @brief Display a root plot of a pulse fit
+ * @brief fit the entry range of inName selected by opts into outName
+ *
+ * digs must already be configured, their fit counters are reset first.
+ * With opts.resume an output with a matching checkpoint is continued after
+ * its last saved entry
+ *
+ * @return number of processed entries
  */
-void displayFit(TemplateFitter& tf, const TemplateFitter::Output& out,
-                const std::vector<UShort_t>& sampleTimes, const std::vector<UShort_t>& trace,
-                const detector& det);
+Long64_t analyzeFile(const std::string& inName, const std::string& outName,
+                     std::vector<std::unique_ptr<digitizer>>& digs,
+                     const json11::Json& conf, const runOptions& opts);
 
-void processTrace(UShort_t* trace, detector& det, std::size_t len);
+/**
+ * @brief fit events from a growing run file, or with stream set from a
+ * named pipe or socket, as they arrive
+ *
+ * events get the quick estimators only while more than followMaxBacklog
+ * events are waiting, full fits otherwise. Rolling per detector summaries
+ * are published every summaryPeriodSeconds
+ */
+void analyzeFollow(const std::string& inName, const std::string& outName,
+                   std::vector<std::unique_ptr<digitizer>>& digs,
+                   const json11::Json& conf, bool stream);
+
+/**
+ * @brief expand the input argument into a list of input files
+ *
+ * "@list" reads one file name per line from list, an argument with glob
+ * characters is matched with glob, anything else is a single file
+ */
+std::vector<std::string> expandInputs(const std::string& spec);
+
+/**
+ * @brief analyze inputs[i] into outputs[i] on nFileWorkers threads, each
+ * with its own clones of digs
+ *
+ * @return total number of processed entries
+ */
+Long64_t runFiles(const std::vector<std::string>& inputs,
+                  const std::vector<std::string>& outputs,
+                  const std::vector<std::unique_ptr<digitizer>>& digs,
+                  const json11::Json& conf, int nFileWorkers,
+                  const runOptions& opts);
+
+/**
+ * @brief join the trees of parts into outName in order and remove the parts
+ */
+void mergeOutputs(const std::vector<std::string>& parts,
+                  const std::string& outName);
 
 int main(int argc, char const* argv[]) {
+  std::vector<std::string> args;
+  runOptions opts = {1, false, -1, -1, 0, 1, false};
+  int nFileWorkers = 1;
+  bool merge = false;
+  bool follow = false;
+  bool stream = false;
+  bool badShard = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if ((arg == "--threads") && (i + 1 < argc)) {
+      opts.nThreads = std::atoi(argv[++i]);
+    } else if ((arg == "--file-workers") && (i + 1 < argc)) {
+      nFileWorkers = std::atoi(argv[++i]);
+    } else if ((arg == "--start") && (i + 1 < argc)) {
+      opts.startEntry = std::atoll(argv[++i]);
+    } else if ((arg == "--end") && (i + 1 < argc)) {
+      opts.endEntry = std::atoll(argv[++i]);
+    } else if ((arg == "--shard") && (i + 1 < argc)) {
+      badShard = std::sscanf(argv[++i], "%d/%d", &opts.shardIndex,
+                             &opts.nShards) != 2;
+    } else if (arg == "--resume") {
+      opts.resume = true;
+    } else if (arg == "--fast") {
+      opts.fastMode = true;
+    } else if (arg == "--merge") {
+      merge = true;
+    } else if (arg == "--follow") {
+      follow = true;
+    } else if (arg == "--stream") {
+      stream = true;
+    } else {
+      args.push_back(arg);
+    }
+  }
+
   std::string configfile;
-  if (argc < 3) {
-    std::cout << "Usage: ./pulseAnalyzer <infile> <outfile> [configfile]"
-              << std::endl;
+  if ((args.size() < 2) || (opts.nThreads < 1) || (nFileWorkers < 1) ||
+      badShard || (opts.nShards < 1) || (opts.shardIndex < 0) ||
+      (opts.shardIndex >= opts.nShards)) {
+    std::cout << "Usage: ./pulseAnalyzer <infile> <outfile> [configfile] "
+                 "[--threads N] [--fast]\n"
+                 "       ./pulseAnalyzer <@filelist|'glob'> <outdir|outfile> "
+                 "[configfile] [--file-workers M] [--merge] [--threads N] "
+                 "[--fast]\n"
+                 "entry ranges: [--start first] [--end last+1] "
+                 "[--shard i/N] [--resume]\n"
+                 "online: ./pulseAnalyzer <growing file|pipe|socket> "
+                 "<outfile> [configfile] <--follow|--stream>" << std::endl;
     exit(EXIT_FAILURE);
-  } else if (argc == 3) {
+  } else if (args.size() == 2) {
     configfile =
       "/home/venanzoni/testBeam/L1Fitting/config/"
       "defaultFitConfig.json";
   } else {
-    configfile = argv[3];
+    configfile = args[2];
   }
 
-  for (auto& file : std::vector<std::string>({argv[1], configfile})) {
+  std::vector<std::string> inputs = expandInputs(args[0]);
+  if (inputs.empty()) {
+    std::cerr << "Error: no input files match " << args[0] << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::vector<std::string> files(inputs);
+  files.push_back(configfile);
+  for (auto& file : files) {
     if (!exists(file)) {
       std::cerr << "Error: " << file << " doesn't exist" << std::endl;
       exit(EXIT_FAILURE);
     }
   }
 
+  // config and templates are loaded once for all input files
   std::vector< std::unique_ptr<digitizer> > digs;
   std::cout << "parse configs" << std::endl;
   auto conf = parseConfig(configfile, digs);
 
-  // setup input and output files and trees
-  TFile inFile(argv[1]);
-  std::unique_ptr<TTree> inTree((TTree*)inFile.Get("t"));
-  inTree->SetBranchStatus("*", 0);
+  if (((opts.nThreads > 1) || (nFileWorkers > 1)) && (!opts.fastMode)) {
+    for (auto& dig : digs) {
+      for (auto& det : dig->detectors) {
+        if (det.conf.draw) {
+          std::cerr << "Warning: drawing requested for " << det.name
+                    << ", running with one thread" << std::endl;
+          opts.nThreads = 1;
+          nFileWorkers = 1;
+        }
+      }
+    }
+  }
+
+  if (follow || stream) {
+    // online runs process every event once, in arrival order, on one thread
+    if ((opts.nThreads > 1) || (nFileWorkers > 1) || merge ||
+        (opts.startEntry >= 0) || (opts.endEntry >= 0) ||
+        (opts.nShards > 1) || opts.resume) {
+      std::cerr << "Error: --threads, --file-workers, --merge, --start, "
+                   "--end, --shard and --resume can't be used with "
+                   "--follow or --stream" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    analyzeFollow(inputs[0], args[1], digs, conf, stream);
+    return 0;
+  }
+
+  // a single plain input file keeps the original one file behaviour
+  if ((inputs.size() == 1) && (args[0] == inputs[0])) {
+    analyzeFile(inputs[0], args[1], digs, conf, opts);
+    return 0;
+  }
+
+  // per file outputs go to the output directory, or to temporary files
+  // next to the merged output
+  std::vector<std::string> outputs;
+  if (!merge) {
+    struct stat dirStat;
+    if ((mkdir(args[1].c_str(), 0755) != 0) &&
+        ((errno != EEXIST) || (stat(args[1].c_str(), &dirStat) != 0) ||
+         !S_ISDIR(dirStat.st_mode))) {
+      std::cerr << "Error: can't create output directory " << args[1]
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (std::size_t i = 0; i < inputs.size(); ++i) {
+    outputs.push_back(merge ? args[1] + ".part" + std::to_string(i) +
+                                  ".root"
+                            : args[1] + "/" + stripExtension(inputs[i]) +
+                                  "_fits.root");
+    // inputs from different directories may share a name
+    auto clash = std::find(outputs.begin(), outputs.end() - 1, outputs[i]);
+    if (clash != outputs.end() - 1) {
+      std::cerr << "Error: " << inputs[clash - outputs.begin()] << " and "
+                << inputs[i] << " would both be written to " << outputs[i]
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
 
-  TFile outf(argv[2], "recreate");
-  TTree outTree("t", "t");
+  auto start = std::chrono::steady_clock::now();
+  Long64_t nEvents =
+      runFiles(inputs, outputs, digs, conf, nFileWorkers, opts);
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start).count();
+
+  if (merge) {
+    mergeOutputs(outputs, args[1]);
+  }
+
+  std::cout << "processed " << inputs.size() << " files, " << nEvents
+            << " events in " << seconds << " s, "
+            << (seconds > 0 ? nEvents / seconds : 0) << " events/sec"
+            << std::endl;
+  return 0;
+}
+
+Long64_t analyzeFile(const std::string& inName, const std::string& outName,
+                     std::vector<std::unique_ptr<digitizer>>& digs,
+                     const json11::Json& conf, const runOptions& opts) {
   for (auto& dig : digs) {
-    if (dig->type == "caen5730") {
-      inTree->SetBranchStatus(dig->branchName.c_str(), 1);
+    for (auto& det : dig->detectors) {
+      det.fitStats = fitCounters();
+    }
+  }
 
-      std::cout << inTree->SetBranchAddress(dig->branchName.c_str(),
-					    dig->getStructAddress()) << std::endl;
+  std::unique_lock<std::mutex> rootLock(rootObjectMutex);
 
-      for (auto& det : dig->detectors) {
-        outTree.Branch(
-		       det.name.c_str(), &det.pSum.energy,
-		       "energy/D:baseline/D:threeSampleAmpl/D:time/D:threeSampleTime/"
-		       "D:chi2/D:fitConverged/O");
+  // setup input and output files and trees
+  inputSource input;
+  openInput(inName, input, digs,
+            static_cast<Long64_t>(conf["treeCacheMB"].number_value() * 1024 *
+                                  1024));
+  executionPlan plan;
+  buildPlan(input, digs, plan);
+
+  // entry range: command line, else config start, then the shard
+  Long64_t firstEntry =
+      opts.startEntry >= 0
+          ? opts.startEntry
+          : static_cast<Long64_t>(conf["startEntry"].number_value());
+  Long64_t endEntry = getEntries(input);
+  if ((opts.endEntry >= 0) && (opts.endEntry < endEntry)) {
+    endEntry = opts.endEntry;
+  }
+  firstEntry = std::min(firstEntry, endEntry);
+  const Long64_t rangeLength = endEntry - firstEntry;
+  endEntry = firstEntry + rangeLength * (opts.shardIndex + 1) / opts.nShards;
+  firstEntry = firstEntry + rangeLength * opts.shardIndex / opts.nShards;
+
+  // resume after the entries the checkpointed output already holds
+  checkpoint::state cp;
+  bool resuming = opts.resume &&
+                  checkpoint::read(checkpoint::pathFor(outName), cp) &&
+                  (cp.input == inName) && (cp.firstEntry == firstEntry) &&
+                  (cp.endEntry == endEntry);
+  if (opts.resume && !resuming) {
+    std::cout << "no matching checkpoint for " << outName
+              << ", starting from the beginning" << std::endl;
+  }
+  if (resuming) {
+    TFile saved(outName.c_str());
+    if (saved.IsZombie() || !saved.Get("t")) {
+      std::cout << "no tree to resume in " << outName
+                << ", starting from the beginning" << std::endl;
+      resuming = false;
+    }
+  }
+  if (!resuming) {
+    // a checkpoint left from an earlier run doesn't describe the new output
+    std::remove(checkpoint::pathFor(outName).c_str());
+  }
+  cp = {inName, firstEntry, endEntry, firstEntry};
+
+  TFile outf(outName.c_str(), resuming ? "update" : "recreate");
+  if (conf["compressionAlgorithm"].is_number()) {
+    outf.SetCompressionAlgorithm(conf["compressionAlgorithm"].int_value());
+  }
+  if (conf["compressionLevel"].is_number()) {
+    outf.SetCompressionLevel(conf["compressionLevel"].int_value());
+  }
+  TTree* outTree = resuming ? (TTree*)outf.Get("t") : nullptr;
+  if (!outTree) {
+    outTree = new TTree("t", "t");
+    outTree->SetDirectory(&outf);
+  }
+  if (conf["autoFlush"].is_number()) {
+    outTree->SetAutoFlush(
+        static_cast<Long64_t>(conf["autoFlush"].number_value()));
+  }
+  const int basketSize = conf["basketSize"].is_number()
+                             ? conf["basketSize"].int_value()
+                             : 32000;
+  outputWriter writer(*outTree, plan, digs, basketSize,
+                      std::max(conf["writerBatchEntries"].int_value(), 1),
+                      std::max(conf["writerQueueDepth"].int_value(), 1));
+
+  // the tree as of its last AutoSave is the authority on what is done
+  const Long64_t startEntry = firstEntry + outTree->GetEntries();
+  if (resuming) {
+    std::cout << "resuming " << outName << " at entry " << startEntry
+              << std::endl;
+  }
+  checkpointer checkpoints(outName, cp,
+                           conf["checkpointInterval"].int_value(), writer,
+                           *outTree);
+
+  runMonitor monitor(startEntry, endEntry, conf["progressInterval"].int_value());
+  if (opts.nThreads > 1) {
+    rootLock.unlock();
+    runThreaded(input, digs, plan, writer, startEntry, endEntry,
+                opts.nThreads, opts.fastMode, monitor, checkpoints);
+    rootLock.lock();
+  } else {
+    // ROOT input is read and decompressed ahead on a second thread
+    std::unique_ptr<entryPrefetcher> prefetcher;
+    const int prefetchDepth = conf["prefetchDepth"].int_value();
+    if (input.tree && (prefetchDepth > 0)) {
+      prefetcher.reset(new entryPrefetcher(input, digs, startEntry, endEntry,
+                                           prefetchDepth));
+      prefetcher->retarget(plan, digs);
+      // the main input is no longer read, only the reader's needs a cache
+      input.tree->SetCacheSize(0);
+    }
+    rootLock.unlock();
+    for (Long64_t i = startEntry; i < endEntry; ++i) {
+      ULong64_t start = readCycles();
+      // with a prefetcher the plan reads the traces from the entry's slot
+      Long64_t traceEntry = i;
+      if (prefetcher) {
+        traceEntry = prefetcher->readNext();
+      } else {
+        readEntry(input, i);
       }
+      plan.counters.cycles[stageRead] += readCycles() - start;
+
+      processEntry(plan, traceEntry, opts.fastMode);
+
+      start = readCycles();
+      writer.addEntry();
+      plan.counters.cycles[stageFill] += readCycles() - start;
+      monitor.entryDone(i);
+      checkpoints.entryDone(i);
     }
+    rootLock.lock();
   }
 
-  for (int i = conf["startEntry"].int_value(); i < inTree->GetEntries(); ++i) {
-    inTree->GetEntry(i);
+  ULong64_t writeStart = readCycles();
+  writer.finish();
+  outf.cd();
+  outTree->Write("", TObject::kOverwrite);
+  plan.counters.cycles[stageFill] += readCycles() - writeStart;
 
-    for (auto& dig : digs) {
-      if (dig->type == "caen5730") {
-        for (auto& det : dig->detectors) {
-          processTrace(dig->getTrace(det.conf.channel), 
-		       det, 
-		       dig->getTraceLength());
-        }
+  // the entry range lets mergeShards put shard outputs in order, the input
+  // name and size let it check they come from the same input
+  TParameter<Long64_t>("firstEntry", firstEntry)
+      .Write("", TObject::kOverwrite);
+  TParameter<Long64_t>("endEntry", endEntry).Write("", TObject::kOverwrite);
+  TNamed("input", inName.c_str()).Write("", TObject::kOverwrite);
+  TParameter<Long64_t>("inputEntries", getEntries(input))
+      .Write("", TObject::kOverwrite);
+
+  std::string summary = monitor.summary(plan.counters, digs);
+  std::cout << "run summary\n" << summary;
+  if (conf["storeRunSummary"].bool_value()) {
+    TNamed runSummary("runSummary", summary.c_str());
+    runSummary.Write("", TObject::kOverwrite);
+  }
+  outf.Close();
+  checkpoint::write(checkpoint::pathFor(outName),
+                    {inName, firstEntry, endEntry, endEntry});
+
+  return monitor.getNEvents();
+}
+
+void analyzeFollow(const std::string& inName, const std::string& outName,
+                   std::vector<std::unique_ptr<digitizer>>& digs,
+                   const json11::Json& conf, bool stream) {
+  inputSource input;
+  input.tree = nullptr;
+  input.treeCacheSize = 0;
+  std::unique_ptr<eventFeed> feed;
+  if (stream) {
+    // the stream carries the caen5730 structs only
+    for (auto dig = digs.begin(); dig != digs.end();) {
+      if ((*dig)->type != "caen5730") {
+        std::cerr << "Warning: " << (*dig)->branchName
+                  << " is not in the stream, skipping it" << std::endl;
+        dig = digs.erase(dig);
+      } else {
+        ++dig;
       }
     }
-    outTree.Fill();
+    feed = makeStreamFeed(inName, digs);
+  } else {
+    feed = makeGrowingFileFeed(
+        inName, input, digs,
+        static_cast<Long64_t>(conf["treeCacheMB"].number_value() * 1024 *
+                              1024));
   }
+  executionPlan plan;
+  buildPlan(input, digs, plan);
 
-  outTree.Write();
-  outf.Write();
+  std::remove(checkpoint::pathFor(outName).c_str());
+  TFile outf(outName.c_str(), "recreate");
+  TTree* outTree = new TTree("t", "t");
+  outTree->SetDirectory(&outf);
+  const int basketSize = conf["basketSize"].is_number()
+                             ? conf["basketSize"].int_value()
+                             : 32000;
+  outputWriter writer(*outTree, plan, digs, basketSize,
+                      std::max(conf["writerBatchEntries"].int_value(), 1),
+                      std::max(conf["writerQueueDepth"].int_value(), 1));
 
-  return 0;
+  // the output is AutoSaved every checkpointInterval events, so a crash
+  // or a kill loses at most that many. The end of the run isn't known
+  checkpointer checkpoints(outName, {inName, 0, -1, 0},
+                           conf["checkpointInterval"].int_value(), writer,
+                           *outTree);
+
+  // optional settings, the defaults match the shipped config
+  const int pollMs = std::max(
+      conf["followPollMs"].is_number() ? conf["followPollMs"].int_value()
+                                       : 200,
+      1);
+  const double idleSeconds = conf["followIdleSeconds"].is_number()
+                                 ? conf["followIdleSeconds"].number_value()
+                                 : 600;
+  const Long64_t maxBacklog = conf["followMaxBacklog"].is_number()
+                                  ? conf["followMaxBacklog"].int_value()
+                                  : 200;
+  const double publishSeconds =
+      conf["summaryPeriodSeconds"].is_number()
+          ? conf["summaryPeriodSeconds"].number_value()
+          : 10;
+  const std::string summaryFile = conf["summaryFile"].string_value();
+  rollingSummary rolling(plan, conf["summaryWindow"].is_number()
+                                   ? conf["summaryWindow"].int_value()
+                                   : 2000);
+  auto publish = [&]() {
+    if (summaryFile.empty()) {
+      std::cout << rolling.toJson().dump() << std::endl;
+    } else {
+      rolling.publish(summaryFile);
+    }
+  };
+
+  runMonitor monitor(0, -1, conf["progressInterval"].int_value());
+  auto lastEvent = std::chrono::steady_clock::now();
+  auto lastPublish = lastEvent;
+  Long64_t entry = 0;
+  Long64_t nFast = 0;
+  while (!feed->finished()) {
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - lastPublish).count() >=
+        publishSeconds) {
+      publish();
+      lastPublish = now;
+    }
+
+    if (!feed->next(pollMs)) {
+      if ((idleSeconds > 0) &&
+          (std::chrono::duration<double>(now - lastEvent).count() >
+           idleSeconds)) {
+        std::cout << "no events for " << idleSeconds << " s, stopping"
+                  << std::endl;
+        break;
+      }
+      continue;
+    }
+    lastEvent = std::chrono::steady_clock::now();
+
+    // full fits only while we keep up with the daq
+    const bool behind = feed->backlog() > maxBacklog;
+    nFast += behind;
+    processEntry(plan, 0, behind);
+    writer.addEntry();
+    rolling.add();
+    monitor.entryDone(entry);
+    checkpoints.entryDone(entry++);
+  }
+  publish();
+
+  writer.finish();
+  outf.cd();
+  outTree->Write();
+  std::cout << "run summary\n"
+            << "events with quick estimates only: " << nFast << "\n"
+            << monitor.summary(plan.counters, digs);
+  outf.Close();
 }
 
-void processTrace(UShort_t* trace, detector& det, std::size_t len) {
-  std::vector<UShort_t> fitSamples(det.conf.fitLength);
-  UShort_t* peakptr;
-  if (det.conf.negPolarity) {
-    peakptr = std::min_element(trace, trace + len);
+namespace {
+/**
+ * per-thread state for threaded running: private input view, digitizer
+ * clones and a buffer of fit results for the current block of entries
+ */
+struct worker {
+  inputSource input;
+  std::vector<std::unique_ptr<digitizer>> digs;
+  executionPlan plan;
+  std::vector<pulseSummary> results;
+  std::vector<Double_t> triggerResults;
+  Long64_t firstEntry;
+  Long64_t lastEntry;
+  bool fastMode;
+};
+
+void processBlock(worker& w) {
+  w.results.clear();
+  w.triggerResults.clear();
+  for (Long64_t i = w.firstEntry; i < w.lastEntry; ++i) {
+    ULong64_t start = readCycles();
+    readEntry(w.input, i);
+    w.plan.counters.cycles[stageRead] += readCycles() - start;
+    processEntry(w.plan, i, w.fastMode);
+    for (const auto& step : w.plan.steps) {
+      w.results.push_back(step.det->pSum);
+    }
+    for (const auto& trig : w.plan.triggers) {
+      w.triggerResults.push_back(*trig.time);
+    }
+  }
+}
+}
+
+void runThreaded(const inputSource& source,
+                 std::vector<std::unique_ptr<digitizer>>& digs,
+                 executionPlan& plan, outputWriter& writer,
+                 Long64_t startEntry, Long64_t endEntry, int nThreads,
+                 bool fastMode,
+                 runMonitor& monitor, checkpointer& checkpoints) {
+  TThread::Initialize();
+
+  const std::size_t nDetectors = plan.steps.size();
+
+  // all ROOT object creation happens here, before any thread is started
+  std::unique_lock<std::mutex> rootLock(rootObjectMutex);
+  std::vector<worker> workers(nThreads);
+  for (auto& w : workers) {
+    for (const auto& dig : digs) {
+      w.digs.push_back(dig->clone());
+    }
+    reopenInput(source, w.input, w.digs);
+    buildPlan(w.input, w.digs, w.plan);
+    w.fastMode = fastMode;
+    w.results.reserve(entriesPerBlock * nDetectors);
+  }
+  rootLock.unlock();
+
+  for (Long64_t roundStart = startEntry; roundStart < endEntry;
+       roundStart += nThreads * entriesPerBlock) {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; ++i) {
+      workers[i].firstEntry =
+          std::min(roundStart + i * entriesPerBlock, endEntry);
+      workers[i].lastEntry =
+          std::min(workers[i].firstEntry + entriesPerBlock, endEntry);
+      threads.emplace_back(processBlock, std::ref(workers[i]));
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    // merge back in entry order
+    for (const auto& w : workers) {
+      auto result = w.results.begin();
+      auto triggerResult = w.triggerResults.begin();
+      for (Long64_t i = w.firstEntry; i < w.lastEntry; ++i) {
+        for (const auto& step : plan.steps) {
+          step.det->pSum = *result++;
+        }
+        for (const auto& trig : plan.triggers) {
+          *trig.time = *triggerResult++;
+        }
+        ULong64_t start = readCycles();
+        writer.addEntry();
+        plan.counters.cycles[stageFill] += readCycles() - start;
+        monitor.entryDone(i);
+        checkpoints.entryDone(i);
+      }
+    }
+  }
+
+  // read, peak and fit cycles are summed over the worker threads
+  for (const auto& w : workers) {
+    plan.counters.add(w.plan.counters);
+    addFitCounters(plan, w.plan);
+  }
+  rootLock.lock();
+  workers.clear();
+}
+
+std::vector<std::string> expandInputs(const std::string& spec) {
+  std::vector<std::string> inputs;
+  if ((!spec.empty()) && (spec[0] == '@')) {
+    std::ifstream list(spec.substr(1));
+    if (!list) {
+      std::cerr << "Error: can't read file list " << spec.substr(1)
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::string line;
+    while (std::getline(list, line)) {
+      if ((!line.empty()) && (line[0] != '#')) {
+        inputs.push_back(line);
+      }
+    }
+  } else if (spec.find_first_of("*?[") != std::string::npos) {
+    glob_t matches;
+    if (glob(spec.c_str(), 0, nullptr, &matches) == 0) {
+      for (std::size_t i = 0; i < matches.gl_pathc; ++i) {
+        inputs.push_back(matches.gl_pathv[i]);
+      }
+    }
+    globfree(&matches);
   } else {
-    peakptr = std::max_element(trace, trace + len);
-  }
-
-  assert(peakptr - det.conf.peakIndex >= trace);
-  assert(peakptr - det.conf.peakIndex + det.conf.fitLength <=
-	 trace + len);
-  std::copy(peakptr - det.conf.peakIndex,
-	    peakptr - det.conf.peakIndex + det.conf.fitLength,
-	    fitSamples.begin());
-
-  //try fit at 3 different starting points before giving up
-  std::vector<int> timeOffsets = {0, 1, -1};
-  TemplateFitter::Output out;
-  bool successfulFit = false;
-  for (std::size_t i = 0; (!successfulFit) && (i < timeOffsets.size()); ++i) {
-    // for now noise is set to one here, doesn't matter as long as it's flat
-    out = det.fitter.fit(fitSamples, det.conf.peakIndex + timeOffsets[i]);
-    if ((std::abs(out.times[0] - det.conf.peakIndex) < det.conf.wiggleRoom) &&
-	(out.converged) &&
-	(det.conf.negPolarity ? (out.scales[0] < 0) : (out.scales[0] > 0))) {
-        successfulFit = true;
-    }
-  }
-  
-  double tsa =
-    peakptr[0] +
-    (peakptr[1] - peakptr[-1]) * (peakptr[1] - peakptr[-1]) /
-    (16.0 * peakptr[0] - 8.0 * (peakptr[1] + peakptr[-1]));
-  double tst =
-    peakptr - trace +
-    (peakptr[1] - peakptr[-1]) /
-    (4.0 * peakptr[0] - 2.0 * (peakptr[1] + peakptr[-1]));
-
-  det.pSum = {out.scales[0], out.pedestal, tsa - out.pedestal,
-	      out.times[0] + (peakptr - trace), tst, out.chi2,
-	      out.converged};
-
-  if (det.conf.negPolarity) {
-    det.pSum.energy *= -1;
-    det.pSum.threeSampleAmpl *= -1;
-  }
-
-  if (det.conf.draw) {
-    std::vector<UShort_t> times(fitSamples.size());
-    std::iota(times.begin(), times.end(),
-	      peakptr - det.conf.peakIndex - trace);
-    displayFit(det.fitter, out, times, fitSamples, det);
+    inputs.push_back(spec);
+  }
+  return inputs;
+}
+
+Long64_t runFiles(const std::vector<std::string>& inputs,
+                  const std::vector<std::string>& outputs,
+                  const std::vector<std::unique_ptr<digitizer>>& digs,
+                  const json11::Json& conf, int nFileWorkers,
+                  const runOptions& opts) {
+  TThread::Initialize();
+  nFileWorkers = std::min<int>(nFileWorkers, inputs.size());
+
+  // the template clones are made here, before any thread is started
+  std::vector<std::vector<std::unique_ptr<digitizer>>> workerDigs(
+      nFileWorkers);
+  for (auto& wDigs : workerDigs) {
+    for (const auto& dig : digs) {
+      wDigs.push_back(dig->clone());
+    }
+  }
+
+  std::atomic<std::size_t> nextFile(0);
+  std::atomic<Long64_t> nEvents(0);
+  auto work = [&](std::vector<std::unique_ptr<digitizer>>& wDigs) {
+    for (std::size_t i = nextFile++; i < inputs.size(); i = nextFile++) {
+      std::cout << "analyzing " << inputs[i] << " into " << outputs[i]
+                << std::endl;
+      nEvents += analyzeFile(inputs[i], outputs[i], wDigs, conf, opts);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (auto& wDigs : workerDigs) {
+    threads.emplace_back(work, std::ref(wDigs));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return nEvents;
+}
+
+void mergeOutputs(const std::vector<std::string>& parts,
+                  const std::string& outName) {
+  TChain chain("t");
+  for (const auto& part : parts) {
+    chain.Add(part.c_str());
+  }
+  TFile outf(outName.c_str(), "recreate");
+  // Merge returns the number of files written, 0 on failure
+  const Long64_t nFiles = outf.IsZombie() ? 0 : chain.Merge(&outf, 0, "keep");
+  outf.Close();
+  if (nFiles <= 0) {
+    std::cerr << "Error: merging into " << outName
+              << " failed, the per file outputs are kept" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  for (const auto& part : parts) {
+    std::remove(part.c_str());
+    std::remove(checkpoint::pathFor(part).c_str());
   }
 }
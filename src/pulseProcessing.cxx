@@ -0,0 +1,360 @@
+/**
+ * per event processing for pulse analysis
+ */
+
+#include "pulseProcessing.hh"
+
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstdlib>
+
+/**
+ * @brief Display a root plot of a pulse fit
+ */
+void displayFit(TemplateFitter* tf, const TemplateFitter::Output& out,
+                const std::vector<UShort_t>& sampleTimes, const std::vector<UShort_t>& trace,
+                const detector& det);
+
+namespace {
+void connectTree(inputSource& source,
+                 std::vector<std::unique_ptr<digitizer>>& digs,
+                 bool verbose) {
+  source.file.reset(new TFile(source.fileName.c_str()));
+  source.tree = (TTree*)source.file->Get("t");
+  source.tree->SetBranchStatus("*", 0);
+  for (auto& dig : digs) {
+    source.tree->SetBranchStatus(dig->branchName.c_str(), 1);
+    int code = source.tree->SetBranchAddress(dig->branchName.c_str(),
+                                             dig->getStructAddress());
+    if (verbose) {
+      std::cout << code << std::endl;
+    }
+  }
+  if (source.treeCacheSize > 0) {
+    source.tree->SetCacheSize(source.treeCacheSize);
+    for (auto& dig : digs) {
+      source.tree->AddBranchToCache(dig->branchName.c_str(), kTRUE);
+    }
+  }
+}
+
+/**
+ * @brief place the search window of step for the current event, clipped to
+ * the trace
+ */
+void placeSearchWindow(const planStep& step, searchWindow& window) {
+  const long traceLength = step.traceLength;
+  const fitConfiguration& conf = step.det->conf;
+  window.flags = 0;
+  long first = conf.searchStart;
+  if (step.searchTrigger) {
+    if (std::isnan(*step.searchTrigger)) {
+      // no trigger pulse, fall back to the whole trace
+      window = {0, step.traceLength, flagWindowClipped | flagNoTrigger};
+      return;
+    }
+    first += static_cast<long>(std::floor(*step.searchTrigger));
+  }
+  long last = conf.searchLength > 0 ? first + conf.searchLength : traceLength;
+  if ((first < 0) || (last > traceLength)) {
+    window.flags |= flagWindowClipped;
+    first = std::max(first, 0L);
+    last = std::min(last, traceLength);
+  }
+  if (last <= first) {
+    window = {0, step.traceLength, flagWindowClipped};
+    return;
+  }
+  window.start = first;
+  window.length = last - first;
+}
+}
+
+void openInput(const std::string& fileName, inputSource& source,
+               std::vector<std::unique_ptr<digitizer>>& digs,
+               Long64_t treeCacheSize) {
+  source.fileName = fileName;
+  source.tree = nullptr;
+  source.treeCacheSize = treeCacheSize;
+  if (!traceCache::isTraceCache(fileName)) {
+    connectTree(source, digs, true);
+    return;
+  }
+
+  source.cache.reset(new TraceCache(fileName));
+  for (auto& dig : digs) {
+    int branch = source.cache->findBranch(dig->branchName);
+    if ((branch < 0) ||
+        (source.cache->getTraceLength(branch) != dig->getTraceLength())) {
+      std::cerr << "Error: " << dig->branchName << " not in trace cache "
+                << fileName << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (source.cache->getNTriggers(branch) != dig->getNGroups()) {
+      std::cerr << "Error: trace cache " << fileName << " has "
+                << source.cache->getNTriggers(branch)
+                << " trigger traces for " << dig->branchName << ", expected "
+                << dig->getNGroups() << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    source.cacheBranches.push_back(branch);
+  }
+}
+
+void reopenInput(const inputSource& source, inputSource& copy,
+                 std::vector<std::unique_ptr<digitizer>>& digs) {
+  copy.fileName = source.fileName;
+  copy.tree = nullptr;
+  copy.treeCacheSize = source.treeCacheSize;
+  copy.cache = source.cache;
+  copy.cacheBranches = source.cacheBranches;
+  if (!copy.cache) {
+    connectTree(copy, digs, false);
+  }
+}
+
+Long64_t getEntries(const inputSource& source) {
+  return source.cache ? source.cache->getEntries()
+                      : source.tree->GetEntries();
+}
+
+void buildPlan(const inputSource& source,
+               std::vector<std::unique_ptr<digitizer>>& digs,
+               executionPlan& plan) {
+  plan.steps.clear();
+  plan.triggers.clear();
+  for (std::size_t d = 0; d < digs.size(); ++d) {
+    digitizer& dig = *digs[d];
+    const std::size_t len = dig.getTraceLength();
+    const std::size_t stride = source.cache ? len : 0;
+    auto traceBase = [&](int channel) -> const UShort_t* {
+      if (source.cache) {
+        return source.cache->getTrace(source.cacheBranches[d], channel, 0);
+      }
+      return dig.getTrace(channel);
+    };
+
+    if (dig.needsTriggerTimes()) {
+      for (std::size_t g = 0; g < dig.getNGroups(); ++g) {
+        const UShort_t* base =
+            source.cache ? source.cache->getTriggerTrace(
+                               source.cacheBranches[d], g, 0)
+                         : dig.getTriggerTrace(g);
+        plan.triggers.push_back(
+            {base, stride, len, dig.minTriggerAmplitude, &dig.triggerTimes[g]});
+      }
+    }
+
+    for (auto& det : dig.detectors) {
+      const Double_t* groupTime =
+          dig.needsTriggerTimes()
+              ? &dig.triggerTimes[dig.getGroup(det.conf.channel)]
+              : nullptr;
+      plan.steps.push_back(
+          {traceBase(det.conf.channel), stride, len, &det,
+           dig.triggerCorrection ? groupTime : nullptr,
+           det.conf.searchFromTrigger ? groupTime : nullptr});
+    }
+  }
+
+  plan.inputs.resize(plan.steps.size());
+  plan.windows.resize(plan.steps.size());
+  plan.estimates.resize(plan.steps.size());
+  for (std::size_t i = 0; i < plan.steps.size(); ++i) {
+    plan.inputs[i] = {plan.steps[i].traceBase, plan.steps[i].traceLength,
+                      plan.steps[i].det->conf.negPolarity};
+  }
+}
+
+void addFitCounters(executionPlan& plan, const executionPlan& other) {
+  for (std::size_t j = 0; j < plan.steps.size(); ++j) {
+    plan.steps[j].det->fitStats.add(other.steps[j].det->fitStats);
+  }
+}
+
+void processEntry(executionPlan& plan, Long64_t i, bool fastMode) {
+  const std::size_t nSteps = plan.steps.size();
+  ULong64_t start = readCycles();
+
+  // one trigger time per group, shared by all of its channels. Trigger
+  // relative search windows need them before the peak search
+  for (const auto& trig : plan.triggers) {
+    *trig.time = estimateTriggerTime(trig.traceBase + i * trig.entryStride,
+                                     trig.traceLength, trig.minAmplitude);
+  }
+
+  for (std::size_t j = 0; j < nSteps; ++j) {
+    const planStep& step = plan.steps[j];
+    searchWindow& window = plan.windows[j];
+    placeSearchWindow(step, window);
+    plan.inputs[j].trace =
+        step.traceBase + i * step.entryStride + window.start;
+    plan.inputs[j].len = window.length;
+  }
+  estimatePulses(plan.inputs.data(), nSteps, plan.estimates.data());
+
+  // back to trace sample indices
+  for (std::size_t j = 0; j < nSteps; ++j) {
+    searchWindow& window = plan.windows[j];
+    quickEstimate& est = plan.estimates[j];
+    if ((est.peakIndex == 0) || (est.peakIndex + 1 == window.length)) {
+      window.flags |= flagPeakOnEdge;
+    }
+    est.peakIndex += window.start;
+    est.threeSampleTime += window.start;
+    plan.inputs[j].trace -= window.start;
+  }
+  ULong64_t peakDone = readCycles();
+  plan.counters.cycles[stagePeak] += peakDone - start;
+
+  for (std::size_t j = 0; j < nSteps; ++j) {
+    const planStep& step = plan.steps[j];
+    if (fastMode) {
+      processTraceFast(plan.inputs[j].trace, *step.det, step.traceLength,
+                       plan.estimates[j]);
+    } else if (step.det->conf.fitThreshold > 0) {
+      // zero suppression, the quick estimate decides whether to fit
+      processTraceFast(plan.inputs[j].trace, *step.det, step.traceLength,
+                       plan.estimates[j]);
+      if (step.det->pSum.energy < step.det->conf.fitThreshold) {
+        ++step.det->fitStats.skipped;
+      } else {
+        processTrace(plan.inputs[j].trace, *step.det, step.traceLength,
+                     plan.estimates[j]);
+      }
+    } else {
+      processTrace(plan.inputs[j].trace, *step.det, step.traceLength,
+                   plan.estimates[j]);
+    }
+
+    step.det->pSum.flags |= plan.windows[j].flags;
+    if (step.triggerTime) {
+      if (std::isnan(*step.triggerTime)) {
+        step.det->pSum.flags |= flagNoTrigger;
+      } else {
+        step.det->pSum.time -= *step.triggerTime;
+        step.det->pSum.threeSampleTime -= *step.triggerTime;
+      }
+    }
+  }
+  plan.counters.cycles[stageFit] += readCycles() - peakDone;
+}
+
+void processTraceFast(const UShort_t* trace, detector& det, std::size_t len,
+                      const quickEstimate& est) {
+  // pre-pulse part of the fit window, clamped to the trace
+  std::size_t first = est.peakIndex > det.conf.peakIndex
+                          ? est.peakIndex - det.conf.peakIndex
+                          : 0;
+  std::size_t last = est.peakIndex > det.conf.wiggleRoom
+                         ? est.peakIndex - det.conf.wiggleRoom
+                         : 0;
+  last = std::min(last, len);
+  double baseline = trace[first];
+  if (last > first) {
+    baseline = std::accumulate(trace + first, trace + last, 0.0) /
+               (last - first);
+  }
+
+  double ampl = est.threeSampleAmpl - baseline;
+  det.pSum = {ampl, baseline, ampl, est.threeSampleTime,
+              est.threeSampleTime, 0, 0, false, false};
+
+  if (det.conf.negPolarity) {
+    det.pSum.energy *= -1;
+    det.pSum.threeSampleAmpl *= -1;
+  }
+}
+
+namespace {
+bool acceptFit(const detector& det, const TemplateFitter::Output& out) {
+  return (std::abs(out.times[0] - det.conf.peakIndex) < det.conf.wiggleRoom) &&
+         (out.converged) &&
+         (det.conf.negPolarity ? (out.scales[0] < 0) : (out.scales[0] > 0));
+}
+}
+
+void processTrace(const UShort_t* trace, detector& det, std::size_t len,
+                  const quickEstimate& est) {
+  if ((est.peakIndex < det.conf.peakIndex) ||
+      (est.peakIndex - det.conf.peakIndex + det.conf.fitLength > len)) {
+    processTraceFast(trace, det, len, est);
+    det.pSum.flags |= flagFitOutside;
+    ++det.fitStats.outside;
+    return;
+  }
+  const UShort_t* peakptr = trace + est.peakIndex;
+  const UShort_t* window = peakptr - det.conf.peakIndex;
+
+  TemplateFitter::Output& out = det.fitOutput;
+  bool successfulFit = false;
+  // fit calls made for this pulse
+  std::size_t i = 0;
+  if (!det.linearFit.empty()) {
+    // rejected linear fits fall back to the iterative fitter below
+    std::copy(window, window + det.conf.fitLength, det.fitSamples.begin());
+    det.linearFit.fit(det.tabTemplate, window, out);
+    ++i;
+    successfulFit = acceptFit(det, out);
+  }
+  // the iterative fitter holds the state of this pulse's fit from here on
+  const bool linearResult = successfulFit;
+  if (!successfulFit) {
+    if (det.conf.threeSampleSeed) {
+      // start at the three sample time, then one sample against the drift of
+      // the failed fit
+      double tstOffset = est.threeSampleTime - est.peakIndex;
+      double seed = det.conf.peakIndex +
+                    (std::abs(tstOffset) < 1 ? tstOffset : 0);
+      for (std::size_t j = 0; (!successfulFit) && (j < 2); ++j, ++i) {
+        if (j > 0) {
+          seed += out.times[0] > seed ? -1 : 1;
+        }
+        fitWindow(det, window, det.conf.fitLength, seed, out);
+        successfulFit = acceptFit(det, out);
+      }
+    } else {
+      //try fit at 3 different starting points before giving up
+      static const int timeOffsets[] = {0, 1, -1};
+      for (std::size_t j = 0; (!successfulFit) && (j < 3); ++j, ++i) {
+        // for now noise is set to one here, doesn't matter as long as it's flat
+        fitWindow(det, window, det.conf.fitLength,
+                  det.conf.peakIndex + timeOffsets[j], out);
+        successfulFit = acceptFit(det, out);
+      }
+    }
+  }
+
+  ++det.fitStats.fits;
+  det.fitStats.fitCalls += i;
+  if (successfulFit) {
+    ++det.fitStats.attempts[std::min<std::size_t>(i, 3) - 1];
+  } else {
+    ++det.fitStats.rejected;
+  }
+  if (!out.converged) {
+    ++det.fitStats.notConverged;
+  }
+  
+  double tsa = est.threeSampleAmpl;
+  double tst = est.threeSampleTime;
+
+  // times are trace sample indices on every path, like the quick estimate
+  det.pSum = {out.scales[0], out.pedestal, tsa - out.pedestal,
+	      out.times[0] + (window - trace), tst, out.chi2, 0,
+	      out.converged, true};
+
+  if (det.conf.negPolarity) {
+    det.pSum.energy *= -1;
+    det.pSum.threeSampleAmpl *= -1;
+  }
+
+  if (det.conf.draw) {
+    std::vector<UShort_t> times(det.fitSamples.size());
+    std::iota(times.begin(), times.end(), window - trace);
+    displayFit(linearResult ? nullptr : &det.fitter, out, times,
+               det.fitSamples, det);
+  }
+}
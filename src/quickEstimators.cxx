@@ -0,0 +1,155 @@
+/**
+ * peak search and three sample estimators, with an AVX2 peak search
+ * selected at run time
+ */
+
+#include "quickEstimators.hh"
+
+#include <cstdlib>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QUICK_ESTIMATORS_AVX2
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// flipping every bit turns a search for the first maximum into a search
+// for the first minimum
+inline UShort_t polarityMask(bool negPolarity) {
+  return negPolarity ? 0 : 0xFFFF;
+}
+
+std::size_t findPeakScalar(const UShort_t* trace, std::size_t len,
+                           UShort_t mask) {
+  std::size_t peak = 0;
+  UShort_t best = trace[0] ^ mask;
+  for (std::size_t i = 1; i < len; ++i) {
+    UShort_t value = trace[i] ^ mask;
+    if (value < best) {
+      best = value;
+      peak = i;
+    }
+  }
+  return peak;
+}
+
+#ifdef QUICK_ESTIMATORS_AVX2
+__attribute__((target("avx2"))) std::size_t findPeakAvx2(
+    const UShort_t* trace, std::size_t len, UShort_t mask) {
+  const std::size_t nVec = len / 16;
+  if (nVec == 0) {
+    return findPeakScalar(trace, len, mask);
+  }
+
+  // first pass: extremum value
+  const __m256i vmask = _mm256_set1_epi16(static_cast<short>(mask));
+  __m256i vmin = _mm256_set1_epi16(static_cast<short>(0xFFFF));
+  for (std::size_t i = 0; i < nVec; ++i) {
+    __m256i v = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(trace + 16 * i));
+    vmin = _mm256_min_epu16(vmin, _mm256_xor_si256(v, vmask));
+  }
+  __m128i m = _mm_min_epu16(_mm256_castsi256_si128(vmin),
+                            _mm256_extracti128_si256(vmin, 1));
+  // minpos works on unsigned 16 bit words
+  UShort_t best = static_cast<UShort_t>(_mm_cvtsi128_si32(_mm_minpos_epu16(m)));
+  for (std::size_t i = 16 * nVec; i < len; ++i) {
+    UShort_t value = trace[i] ^ mask;
+    best = value < best ? value : best;
+  }
+
+  // second pass: first index holding it
+  const __m256i vbest = _mm256_set1_epi16(static_cast<short>(best));
+  for (std::size_t i = 0; i < nVec; ++i) {
+    __m256i v = _mm256_xor_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(trace + 16 * i)),
+        vmask);
+    unsigned bits = static_cast<unsigned>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi16(v, vbest)));
+    if (bits) {
+      return 16 * i + __builtin_ctz(bits) / 2;
+    }
+  }
+  for (std::size_t i = 16 * nVec; i < len; ++i) {
+    if ((trace[i] ^ mask) == best) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+bool haveAvx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+#endif
+
+std::size_t findPeak(const UShort_t* trace, std::size_t len, UShort_t mask) {
+#ifdef QUICK_ESTIMATORS_AVX2
+  if (haveAvx2()) {
+    return findPeakAvx2(trace, len, mask);
+  }
+#endif
+  return findPeakScalar(trace, len, mask);
+}
+
+quickEstimate threeSampleEstimate(const UShort_t* trace, std::size_t len,
+                                  std::size_t peakIndex) {
+  // at the trace edges the missing neighbour is replaced by the peak itself
+  const UShort_t* peakptr = trace + peakIndex;
+  int before = peakIndex > 0 ? peakptr[-1] : peakptr[0];
+  int after = peakIndex + 1 < len ? peakptr[1] : peakptr[0];
+
+  quickEstimate est;
+  est.peakIndex = peakIndex;
+  est.threeSampleAmpl = peakptr[0] + (after - before) * (after - before) /
+                                         (16.0 * peakptr[0] -
+                                          8.0 * (after + before));
+  est.threeSampleTime =
+      peakIndex + (after - before) / (4.0 * peakptr[0] - 2.0 * (after + before));
+  return est;
+}
+}
+
+quickEstimate estimatePulse(const UShort_t* trace, std::size_t len,
+                            bool negPolarity) {
+  return threeSampleEstimate(
+      trace, len, findPeak(trace, len, polarityMask(negPolarity)));
+}
+
+void estimatePulses(const estimatorInput* inputs, std::size_t n,
+                    quickEstimate* out) {
+  for (std::size_t i = 0; i < n; ++i) {
+    out[i] = estimatePulse(inputs[i].trace, inputs[i].len,
+                           inputs[i].negPolarity);
+  }
+}
+
+double estimateTriggerTime(const UShort_t* trigger, std::size_t len,
+                           double minAmplitude) {
+  const int baseline = trigger[0];
+  int extremum = baseline;
+  for (std::size_t i = 1; i < len; ++i) {
+    int distance = trigger[i] - baseline;
+    int best = extremum - baseline;
+    if (distance * distance > best * best) {
+      extremum = trigger[i];
+    }
+  }
+  if ((extremum == baseline) ||
+      (std::abs(extremum - baseline) < minAmplitude)) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+
+  const double threshold = 0.5 * (baseline + extremum);
+  for (std::size_t i = 1; i < len; ++i) {
+    double before = trigger[i - 1] - threshold;
+    double after = trigger[i] - threshold;
+    if ((before * after <= 0) && (trigger[i] != trigger[i - 1])) {
+      return i - 1 + before / (before - after);
+    }
+  }
+  return std::numeric_limits<double>::quiet_NaN();
+}
@@ -0,0 +1,72 @@
+/**
+ * rolling per detector summaries for online analysis
+ */
+
+#include "rollingSummary.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+rollingSummary::rollingSummary(const executionPlan& plan, std::size_t window)
+    : plan_(plan),
+      window_(std::max<std::size_t>(window, 1)),
+      nAdded_(0),
+      samples_(window_ * plan.steps.size()) {}
+
+void rollingSummary::add() {
+  const std::size_t nSteps = plan_.steps.size();
+  sample* row = &samples_[(nAdded_ % window_) * nSteps];
+  for (std::size_t j = 0; j < nSteps; ++j) {
+    const pulseSummary& pSum = plan_.steps[j].det->pSum;
+    row[j] = {pSum.energy, pSum.time, static_cast<bool>(pSum.fitted),
+              static_cast<bool>(pSum.fitConverged)};
+  }
+  ++nAdded_;
+}
+
+json11::Json rollingSummary::toJson() const {
+  const std::size_t nSteps = plan_.steps.size();
+  const std::size_t n = std::min<Long64_t>(nAdded_, window_);
+  json11::Json::array detectors;
+  for (std::size_t j = 0; j < nSteps; ++j) {
+    double sumE = 0, sumE2 = 0, sumT = 0, sumT2 = 0;
+    std::size_t nFitted = 0, nConverged = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      const sample& s = samples_[i * nSteps + j];
+      sumE += s.energy;
+      sumE2 += s.energy * s.energy;
+      sumT += s.time;
+      sumT2 += s.time * s.time;
+      nFitted += s.fitted;
+      nConverged += s.converged;
+    }
+    const double norm = n > 0 ? 1.0 / n : 0;
+    const double meanE = sumE * norm;
+    const double meanT = sumT * norm;
+    detectors.push_back(json11::Json::object{
+        {"name", plan_.steps[j].det->name},
+        {"events", static_cast<double>(n)},
+        {"energyMean", meanE},
+        {"energyRms", std::sqrt(std::max(sumE2 * norm - meanE * meanE, 0.0))},
+        {"timeMean", meanT},
+        {"timeRms", std::sqrt(std::max(sumT2 * norm - meanT * meanT, 0.0))},
+        {"fittedFraction", nFitted * norm},
+        {"convergedFraction", nFitted > 0 ? nConverged / double(nFitted) : 0}});
+  }
+  return json11::Json::object{{"totalEvents", static_cast<double>(nAdded_)},
+                              {"detectors", detectors}};
+}
+
+void rollingSummary::publish(const std::string& path) const {
+  const std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream file(tmpPath);
+    file << toJson().dump() << std::endl;
+  }
+  if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    std::cerr << "Warning: can't publish summary to " << path << std::endl;
+  }
+}
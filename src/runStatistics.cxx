@@ -0,0 +1,107 @@
+/**
+ * run instrumentation for pulse analysis
+ */
+
+#include "runStatistics.hh"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+#include "fitterStructs.hh"
+
+namespace {
+const char* stageNames[nRunStages] = {"read", "peak", "fit", "fill"};
+}
+
+ULong64_t readCycles() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+runMonitor::runMonitor(Long64_t firstEntry, Long64_t endEntry,
+                       Long64_t progressInterval)
+    : firstEntry_(firstEntry),
+      endEntry_(endEntry),
+      progressInterval_(progressInterval),
+      nEvents_(0),
+      start_(std::chrono::steady_clock::now()) {}
+
+double runMonitor::getElapsedSeconds() const {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start_).count();
+}
+
+void runMonitor::printProgress(Long64_t entry) const {
+  double seconds = getElapsedSeconds();
+  double rate = seconds > 0 ? nEvents_ / seconds : 0;
+  Long64_t total = endEntry_ - firstEntry_;
+  std::ostringstream ss;
+  ss << "entry " << entry << " (" << nEvents_;
+  // an open ended run has no total
+  if (total > 0) {
+    ss << "/" << total << " events, " << std::fixed << std::setprecision(1)
+       << 100.0 * nEvents_ / total << "%), ";
+  } else {
+    ss << " events), ";
+  }
+  ss << std::fixed << std::setprecision(0) << rate << " events/sec";
+  if ((rate > 0) && (total > 0)) {
+    ss << ", " << (total - nEvents_) / rate << " s left";
+  }
+  std::cout << ss.str() << std::endl;
+}
+
+std::string runMonitor::summary(
+    const stageCounters& counters,
+    const std::vector<std::unique_ptr<digitizer>>& digs) const {
+  std::ostringstream ss;
+  double seconds = getElapsedSeconds();
+  double perEvent = nEvents_ > 0 ? 1.0 / nEvents_ : 0;
+
+  ss << "events: " << nEvents_ << "\n";
+  ss << "wall time [s]: " << seconds << "\n";
+  ss << "events/sec: " << (seconds > 0 ? nEvents_ / seconds : 0) << "\n";
+
+  ULong64_t totalCycles = 0;
+  for (int i = 0; i < nRunStages; ++i) {
+    totalCycles += counters.cycles[i];
+  }
+  ss << "cycles/event by stage:";
+  for (int i = 0; i < nRunStages; ++i) {
+    ss << " " << stageNames[i] << " " << std::fixed << std::setprecision(0)
+       << counters.cycles[i] * perEvent << " (" << std::setprecision(1)
+       << (totalCycles ? 100.0 * counters.cycles[i] / totalCycles : 0)
+       << "%)";
+  }
+  ss.unsetf(std::ios::floatfield);
+  ss << std::setprecision(6) << "\n";
+
+  for (const auto& dig : digs) {
+    for (const auto& det : dig->detectors) {
+      const fitCounters& fc = det.fitStats;
+      const ULong64_t pulses = fc.fits + fc.skipped + fc.outside;
+      if (pulses == 0) {
+        continue;
+      }
+      ss << det.name << ": fits " << fc.fits << ", fit calls/pulse "
+         << (fc.fits ? static_cast<double>(fc.fitCalls) / fc.fits : 0)
+         << ", accepted on attempt 1/2/3 "
+         << fc.attempts[0] << "/" << fc.attempts[1] << "/" << fc.attempts[2]
+         << ", rejected " << fc.rejected << ", not converged "
+         << fc.notConverged << ", skipped below threshold " << fc.skipped
+         << " (" << 100.0 * fc.skipped / pulses << "%), fit window outside "
+         << "trace " << fc.outside << "\n";
+    }
+  }
+  return ss.str();
+}
@@ -0,0 +1,129 @@
+/**
+ * flat, uniformly sampled pulse template
+ */
+
+#include "tabulatedTemplate.hh"
+
+#include <algorithm>
+#include <cassert>
+
+#include "TSpline.h"
+
+TabulatedTemplate::TabulatedTemplate()
+    : tMin_(0),
+      tMax_(0),
+      gridMin_(0),
+      step_(1),
+      invStep_(1),
+      nPoints_(0),
+      values_(nullptr),
+      derivs_(nullptr) {}
+
+TabulatedTemplate::TabulatedTemplate(const TSpline3& spline, double tMin,
+                                     double tMax, std::size_t nPoints)
+    : tMin_(tMin),
+      tMax_(tMax),
+      gridMin_(tMin),
+      step_((tMax - tMin) / (nPoints - 1)),
+      invStep_((nPoints - 1) / (tMax - tMin)),
+      nPoints_(nPoints) {
+  assert(nPoints > 1);
+  assert(tMax > tMin);
+  // values in the first half, derivatives in the second
+  std::shared_ptr<std::vector<double>> tables =
+      std::make_shared<std::vector<double>>(2 * nPoints);
+  double* values = tables->data();
+  double* derivs = values + nPoints;
+  for (std::size_t i = 0; i < nPoints; ++i) {
+    double t = tMin_ + i * step_;
+    values[i] = spline.Eval(t);
+    derivs[i] = spline.Derivative(t) * step_;
+  }
+  storage_ = tables;
+  values_ = values;
+  derivs_ = derivs;
+}
+
+TabulatedTemplate::TabulatedTemplate(std::shared_ptr<const void> storage,
+                                     const double* values,
+                                     const double* derivs, double tMin,
+                                     double tMax, std::size_t nPoints)
+    : tMin_(tMin),
+      tMax_(tMax),
+      gridMin_(tMin),
+      step_((tMax - tMin) / (nPoints - 1)),
+      invStep_((nPoints - 1) / (tMax - tMin)),
+      nPoints_(nPoints),
+      storage_(storage),
+      values_(values),
+      derivs_(derivs) {
+  assert(nPoints > 1);
+  assert(tMax > tMin);
+}
+
+TabulatedTemplate TabulatedTemplate::clipped(double tMin, double tMax) const {
+  TabulatedTemplate copy(*this);
+  copy.tMin_ = std::max(tMin, tMin_);
+  copy.tMax_ = std::min(tMax, tMax_);
+  return copy;
+}
+
+double TabulatedTemplate::eval(double t) const {
+  double value;
+  evalWindow(t, 0, 1, &value, nullptr);
+  return value;
+}
+
+double TabulatedTemplate::derivative(double t) const {
+  double value, deriv;
+  evalWindow(t, 0, 1, &value, &deriv);
+  return deriv;
+}
+
+void TabulatedTemplate::evalWindow(double t0, double step, std::size_t n,
+                                   double* values, double* derivs) const {
+  if (nPoints_ == 0) {
+    for (std::size_t i = 0; i < n; ++i) {
+      values[i] = 0;
+      if (derivs) {
+        derivs[i] = 0;
+      }
+    }
+    return;
+  }
+
+  const double* y = values_;
+  const double* dy = derivs_;
+  const double lastInterval = nPoints_ - 2;
+  for (std::size_t i = 0; i < n; ++i) {
+    double t = t0 + i * step;
+    double inside = (t >= tMin_) && (t <= tMax_) ? 1.0 : 0.0;
+
+    // clamp so out of range times still index valid memory
+    double x = (t - gridMin_) * invStep_;
+    x = x < 0 ? 0 : x;
+    double k = x < lastInterval ? static_cast<int>(x) : lastInterval;
+    std::size_t j = static_cast<std::size_t>(k);
+    double f = x - k;
+    f = f > 1 ? 1 : f;
+
+    // cubic hermite basis
+    double f2 = f * f;
+    double f3 = f2 * f;
+    double h00 = 2 * f3 - 3 * f2 + 1;
+    double h10 = f3 - 2 * f2 + f;
+    double h01 = -2 * f3 + 3 * f2;
+    double h11 = f3 - f2;
+    values[i] = inside * (h00 * y[j] + h10 * dy[j] + h01 * y[j + 1] +
+                          h11 * dy[j + 1]);
+
+    if (derivs) {
+      double g00 = 6 * f2 - 6 * f;
+      double g10 = 3 * f2 - 4 * f + 1;
+      double g01 = -6 * f2 + 6 * f;
+      double g11 = 3 * f2 - 2 * f;
+      derivs[i] = inside * invStep_ * (g00 * y[j] + g10 * dy[j] +
+                                       g01 * y[j + 1] + g11 * dy[j + 1]);
+    }
+  }
+}
@@ -0,0 +1,230 @@
+/**
+ * config reading and trace correction for the fuzzy template builder
+ */
+
+#include "templateBuilder.hh"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+
+#include "json11.hpp"
+
+#include "quickEstimators.hh"
+
+json11::Json valueFromDetectorOrDefault(const std::string& key,
+                                        const json11::Json::object& detector,
+                                        const json11::Json::object& def);
+json11::Json valueFromDetectorOrDefault(const std::string& key,
+                                        const json11::Json::object& detector,
+                                        const json11::Json::object& def,
+                                        const json11::Json& fallback);
+
+void readTemplateConfig(const char* fitConf, const char* detectorName,
+                        templateConfig& conf) {
+  // first read the templateConf
+  const char* tempConfName =
+      "/home/venanzoni/testBeam/L1Fitting/config/makeTemplateConf.json";
+  std::stringstream ss;
+  std::ifstream configfile(tempConfName);
+  ss << configfile.rdbuf();
+  configfile.close();
+  std::string err;
+  auto confJson = json11::Json::parse(ss.str(), err);
+  if (err.size() != 0) {
+    std::cerr << "Parsing error for " << tempConfName << " : " << err
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  auto confMap = confJson.object_items();
+
+  conf.nBinsPseudoTime = confMap.at("nBinsPseudoTime").int_value();
+  conf.nTimeBins = confMap.at("nTimeBins").int_value();
+  conf.baselineFitLength = confMap.at("baselineFitLength").int_value();
+  conf.minPeak = confMap.at("minPeak").int_value();
+  // optional, default is to read the input twice
+  conf.singlePass = confJson["singlePass"].bool_value();
+  conf.maxArenaMB = confJson["maxArenaMB"].number_value();
+  if (conf.singlePass && (conf.maxArenaMB <= 0)) {
+    conf.maxArenaMB = 1024;
+    std::cout << "singlePass without a positive maxArenaMB, keeping up to "
+              << conf.maxArenaMB << " MB of trace windows in memory"
+              << std::endl;
+  }
+  // optional, default is a serial ROOT fit of every bin
+  conf.binFitMethod = confJson["binFitMethod"].is_string()
+                          ? confJson["binFitMethod"].string_value()
+                          : "rootGaus";
+  conf.checkBinFits = confJson["checkBinFits"].bool_value();
+  conf.nThreads = confJson["nThreads"].is_number()
+                      ? confJson["nThreads"].int_value()
+                      : std::thread::hardware_concurrency();
+
+  // now other info from detector conf
+  ss.str("");
+  configfile.open(fitConf);
+  ss << configfile.rdbuf();
+  configfile.close();
+  confJson = json11::Json::parse(ss.str(), err);
+  if (err.size() != 0) {
+    std::cerr << "Parsing error for " << fitConf << " : " << err << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  confMap = confJson.object_items();
+
+  // find detector configuration in any digitizer
+  auto defaults = confMap.at("defaultDetector").object_items();
+  json11::Json::object detector;
+  bool found = false;
+  for (auto dig : confMap.at("digitizers").array_items()) {
+    auto digMap = dig.object_items();
+    for (auto det : digMap.at("detectors").array_items()) {
+      if (det.object_items().at("name") == detectorName) {
+        found = true;
+        detector = det.object_items();
+        conf.digitizerType = digMap.at("type").string_value();
+        conf.branchName = digMap.at("branchName").string_value();
+        break;
+      }
+    }
+    if (found) {
+      break;
+    }
+  }
+
+  if (!found) {
+    std::cerr << detectorName << " not in config file " << fitConf
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  conf.templateLength = valueFromDetectorOrDefault("templateLength", detector,
+                                                   defaults).int_value();
+  conf.bufferZone =
+      valueFromDetectorOrDefault("templateBuffer", detector, defaults)
+          .int_value();
+  conf.negPolarity =
+      valueFromDetectorOrDefault("negPolarity", detector, defaults)
+          .bool_value();
+  conf.channel = detector.at("channel").int_value();
+
+  // optional, by default the whole trace is searched
+  const json11::Json searchWindow = valueFromDetectorOrDefault(
+      "searchWindow", detector, defaults, json11::Json());
+  conf.searchStart = searchWindow["start"].int_value();
+  conf.searchLength = searchWindow["length"].int_value();
+  if (searchWindow["reference"].string_value() == "trigger") {
+    std::cerr << "the template builder reads no trigger traces, the "
+                 "searchWindow of " << detectorName
+              << " is taken relative to the trace" << std::endl;
+  }
+}
+
+traceSummary summarizeTrace(const unsigned short* trace, int traceLength,
+                            const templateConfig& conf,
+                            double* correctedTrace) {
+  const int bufferZone = conf.bufferZone;
+  const int templateLength = conf.templateLength;
+  const int baselineFitLength = conf.baselineFitLength;
+
+  traceSummary results;
+  results.bad = false;
+
+  // find maximum within the search window, clipped to the trace
+  int first = conf.searchStart > 0 ? conf.searchStart : 0;
+  int last = conf.searchLength > 0 ? conf.searchStart + conf.searchLength
+                                   : traceLength;
+  last = last < traceLength ? last : traceLength;
+  if (last <= first) {
+    first = 0;
+    last = traceLength;
+  }
+  const int maxdex =
+      first +
+      estimatePulse(trace + first, last - first, conf.negPolarity).peakIndex;
+  results.peakIndex = maxdex;
+
+  // pseudotime needs both neighbours
+  if ((maxdex == 0) || (maxdex + 1 == traceLength)) {
+    results.pseudoTime = 1;
+    results.bad = true;
+    return results;
+  }
+
+  // calculate pseudotime
+  if (trace[maxdex] == trace[maxdex + 1])
+    results.pseudoTime = 1;
+  else {
+    results.pseudoTime =
+        2.0 / M_PI *
+        atan(static_cast<double>(trace[maxdex - 1] - trace[maxdex]) /
+             (trace[maxdex + 1] - trace[maxdex]));
+  }
+
+  if (conf.negPolarity) {
+    if (trace[maxdex] > conf.minPeak) {
+      results.bad = true;
+      return results;
+    }
+  } else {
+    if (trace[maxdex] < conf.minPeak) {
+      results.bad = true;
+      return results;
+    }
+  }
+
+  // get the baseline
+  if (maxdex - baselineFitLength - bufferZone < 0) {
+    std::cout << "Baseline fit walked off the end of the trace!" << std::endl;
+    results.bad = true;
+    return results;
+  }
+  const unsigned short* pre = trace + maxdex - bufferZone - baselineFitLength;
+  std::uint32_t baselineSum = 0;
+  for (int i = 0; i < baselineFitLength; ++i) {
+    baselineSum += pre[i];
+  }
+  results.baseline = static_cast<double>(baselineSum) / baselineFitLength;
+
+  // get the normalization
+  if (maxdex - bufferZone + templateLength > traceLength) {
+    results.bad = true;
+    return results;
+  }
+  const unsigned short* window = trace + maxdex - bufferZone;
+  std::uint32_t windowSum = 0;
+  for (int i = 0; i < templateLength; ++i) {
+    windowSum += window[i];
+  }
+  results.integral = windowSum - templateLength * results.baseline;
+
+  results.normalizedAmpl =
+      (trace[maxdex] - results.baseline) / results.integral;
+
+  if (correctedTrace) {
+    const double baseline = results.baseline;
+    const double integral = results.integral;
+    for (int i = 0; i < templateLength; ++i) {
+      correctedTrace[i] = (window[i] - baseline) * 1.0 / integral;
+    }
+  }
+
+  return results;
+}
+
+void correctTrace(const unsigned short* trace, const traceSummary& summary,
+                  const templateConfig& conf, double* correctedTrace) {
+  if (summary.bad) {
+    for (int i = 0; i < conf.templateLength; ++i) correctedTrace[i] = 0;
+    return;
+  }
+  for (int i = 0; i < conf.templateLength; ++i) {
+    correctedTrace[i] =
+        (trace[summary.peakIndex - conf.bufferZone + i] - summary.baseline) *
+        1.0 / (summary.integral);
+  }
+}
@@ -0,0 +1,217 @@
+/**
+ * precompiled, memory mappable pulse templates
+ */
+
+#include "templateBundle.hh"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TFile.h"
+#include "TSpline.h"
+
+namespace {
+const char* splineNames[templateBundle::nTables] = {
+    "masterSpline", "errorSpline", "realTimeSpline"};
+
+static_assert(sizeof(templateBundle::fileHeader) % sizeof(double) == 0,
+              "table data must start on a double boundary");
+
+/**
+ * @brief bundle file contents for the splines in rootFile
+ */
+std::shared_ptr<std::vector<double>> buildBundle(const std::string& rootFile,
+                                                 std::size_t nPoints) {
+  TFile file(rootFile.c_str());
+  if (file.IsZombie()) {
+    std::cerr << "could not open template file " << rootFile << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  templateBundle::fileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, templateBundle::magic, sizeof(header.magic));
+  header.version = templateBundle::version;
+  header.nTables = templateBundle::nTables;
+
+  std::vector<double> body;
+  for (int t = 0; t < templateBundle::nTables; ++t) {
+    const TSpline3* spline = (TSpline3*)file.Get(splineNames[t]);
+    if (!spline) {
+      if (t == templateBundle::masterTable) {
+        std::cerr << rootFile << " has no " << splineNames[t] << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      continue;
+    }
+
+    templateBundle::tableHeader& table = header.tables[t];
+    table.tMin = spline->GetXmin();
+    table.tMax = spline->GetXmax();
+    table.nPoints = nPoints;
+    table.nKnots = spline->GetNp();
+
+    // same sampling as the TSpline3 constructor of TabulatedTemplate
+    const double step = (table.tMax - table.tMin) / (nPoints - 1);
+    const std::size_t values = body.size();
+    body.resize(body.size() + 2 * nPoints + 2 * table.nKnots);
+    for (std::size_t i = 0; i < nPoints; ++i) {
+      double x = table.tMin + i * step;
+      body[values + i] = spline->Eval(x);
+      body[values + nPoints + i] = spline->Derivative(x) * step;
+    }
+    const std::size_t knots = values + 2 * nPoints;
+    for (std::size_t i = 0; i < table.nKnots; ++i) {
+      spline->GetKnot(i, body[knots + i], body[knots + table.nKnots + i]);
+    }
+  }
+
+  const std::size_t headerDoubles = sizeof(header) / sizeof(double);
+  std::shared_ptr<std::vector<double>> contents =
+      std::make_shared<std::vector<double>>(headerDoubles + body.size());
+  std::memcpy(contents->data(), &header, sizeof(header));
+  std::copy(body.begin(), body.end(), contents->begin() + headerDoubles);
+  return contents;
+}
+
+// points per sampled spline of bundles compiled at load time, the
+// resolution setFitterTemplate used to sample templates at
+const std::size_t defaultResolution = 10000;
+}
+
+namespace templateBundle {
+
+bool isTemplateBundle(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  char buffer[sizeof(magic)];
+  if (!in.read(buffer, sizeof(buffer))) {
+    return false;
+  }
+  return std::memcmp(buffer, magic, sizeof(magic)) == 0;
+}
+
+void compile(const std::string& rootFile, const std::string& bundlePath,
+             std::size_t nPoints) {
+  if (nPoints < 2) {
+    std::cerr << "template bundles need at least 2 points per table"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::shared_ptr<std::vector<double>> contents =
+      buildBundle(rootFile, nPoints);
+  std::ofstream out(bundlePath, std::ios::binary);
+  out.write(reinterpret_cast<const char*>(contents->data()),
+            contents->size() * sizeof(double));
+  if (!out) {
+    std::cerr << "could not write template bundle " << bundlePath
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+}
+
+std::shared_ptr<const TemplateBundle> TemplateBundle::load(
+    const std::string& path) {
+  static std::mutex cacheMutex;
+  static std::map<std::string, std::weak_ptr<const TemplateBundle>> cache;
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  std::shared_ptr<const TemplateBundle> bundle = cache[path].lock();
+  if (bundle) {
+    return bundle;
+  }
+
+  if (templateBundle::isTemplateBundle(path)) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if ((fd < 0) || (fstat(fd, &st) != 0)) {
+      std::cerr << "could not open template bundle " << path << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    const std::size_t size = st.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      std::cerr << "could not map template bundle " << path << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::shared_ptr<const void> storage(mapping, [size](const void* p) {
+      munmap(const_cast<void*>(p), size);
+    });
+    bundle.reset(new TemplateBundle(path, storage,
+                                    static_cast<const char*>(mapping), size));
+  } else {
+    std::shared_ptr<std::vector<double>> contents =
+        buildBundle(path, defaultResolution);
+    bundle.reset(new TemplateBundle(
+        path, contents, reinterpret_cast<const char*>(contents->data()),
+        contents->size() * sizeof(double)));
+  }
+  cache[path] = bundle;
+  return bundle;
+}
+
+TemplateBundle::TemplateBundle(const std::string& path,
+                               std::shared_ptr<const void> storage,
+                               const char* base, std::size_t size)
+    : path_(path), storage_(storage), header_(nullptr) {
+  header_ = reinterpret_cast<const templateBundle::fileHeader*>(base);
+  if ((size < sizeof(templateBundle::fileHeader)) ||
+      (std::memcmp(header_->magic, templateBundle::magic,
+                   sizeof(templateBundle::magic)) != 0) ||
+      (header_->version != templateBundle::version) ||
+      (header_->nTables != templateBundle::nTables)) {
+    std::cerr << path << " is not a version " << templateBundle::version
+              << " template bundle" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  const double* data = reinterpret_cast<const double*>(
+      base + sizeof(templateBundle::fileHeader));
+  std::size_t nDoubles = 0;
+  for (int t = 0; t < templateBundle::nTables; ++t) {
+    nDoubles += 2 * header_->tables[t].nPoints + 2 * header_->tables[t].nKnots;
+  }
+  if (size != sizeof(templateBundle::fileHeader) + nDoubles * sizeof(double)) {
+    std::cerr << "template bundle " << path << " is truncated" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  for (int t = 0; t < templateBundle::nTables; ++t) {
+    const templateBundle::tableHeader& table = header_->tables[t];
+    if (table.nPoints > 1) {
+      tables_[t] =
+          TabulatedTemplate(storage_, data, data + table.nPoints, table.tMin,
+                            table.tMax, table.nPoints);
+    }
+    knots_[t] = data + 2 * table.nPoints;
+    data += 2 * table.nPoints + 2 * table.nKnots;
+  }
+}
+
+std::unique_ptr<TSpline3> TemplateBundle::makeSpline(
+    templateBundle::table t) const {
+  const std::size_t nKnots = header_->tables[t].nKnots;
+  if (nKnots == 0) {
+    return std::unique_ptr<TSpline3>();
+  }
+  // ROOT 5 takes the knots as non const arrays
+  std::vector<double> x(knots_[t], knots_[t] + nKnots);
+  std::vector<double> y(knots_[t] + nKnots, knots_[t] + 2 * nKnots);
+  std::unique_ptr<TSpline3> spline(
+      new TSpline3(splineNames[t], x.data(), y.data(), nKnots));
+  spline->SetName(splineNames[t]);
+  spline->SetNpx(defaultResolution);
+  return spline;
+}
@@ -0,0 +1,251 @@
+/**
+ * columnar raw trace cache: converter from the daq TTree and mmap reader
+ */
+
+#include "traceCache.hh"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include "common.hh"
+#include "daqStructs.hh"
+
+namespace {
+const std::uint64_t pageSize = 4096;
+
+std::uint64_t roundUpToPage(std::uint64_t offset) {
+  return (offset + pageSize - 1) / pageSize * pageSize;
+}
+
+/**
+ * @brief holds the daq struct a branch is read into
+ */
+struct branchBuffer {
+  std::unique_ptr<daq::caen_5730> caen5730;
+  std::unique_ptr<caen_1742> caen1742;
+  std::uint32_t nChannels;
+  std::uint32_t nTriggers;
+  std::uint32_t traceLength;
+
+  // for the 1742 the group trigger traces come after the channels
+  const UShort_t* getTrace(int channel) const {
+    if (caen5730) {
+      return caen5730->trace[channel];
+    }
+    return channel < CAEN_1742_CH ? caen1742->trace[channel]
+                                  : caen1742->trigger[channel - CAEN_1742_CH];
+  }
+};
+
+/**
+ * @brief read branch name of t into address, exit if it can't be read
+ */
+void connectBranch(TTree& t, const std::string& name, void* address,
+                   const std::string& rootFile) {
+  if (!t.GetBranch(name.c_str())) {
+    std::cerr << "no branch " << name << " in " << rootFile << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  t.SetBranchStatus(name.c_str(), 1);
+  if (t.SetBranchAddress(name.c_str(), address) < 0) {
+    std::cerr << "could not read branch " << name << " of " << rootFile
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+}
+
+namespace traceCache {
+
+bool isTraceCache(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  char buffer[sizeof(magic)];
+  if (!in.read(buffer, sizeof(buffer))) {
+    return false;
+  }
+  return std::memcmp(buffer, magic, sizeof(magic)) == 0;
+}
+
+void convertTree(const std::string& rootFile, const std::string& cachePath,
+                 const std::vector<branchSpec>& branches) {
+  TFile inFile(rootFile.c_str());
+  TTree* t = (TTree*)inFile.Get("t");
+  if (!t) {
+    std::cerr << "no tree t in " << rootFile << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  t->SetBranchStatus("*", 0);
+
+  // set up branches and file layout
+  const std::uint64_t nEntries = t->GetEntries();
+  std::vector<branchBuffer> buffers(branches.size());
+  std::vector<branchHeader> headers(branches.size());
+  std::uint64_t offset = roundUpToPage(
+      sizeof(fileHeader) + branches.size() * sizeof(branchHeader));
+  for (std::size_t i = 0; i < branches.size(); ++i) {
+    branchBuffer& buf = buffers[i];
+    if (branches[i].type == "caen5730") {
+      buf.caen5730.reset(new daq::caen_5730);
+      buf.nChannels = CAEN_5730_CH;
+      buf.nTriggers = 0;
+      buf.traceLength = CAEN_5730_LN;
+      connectBranch(*t, branches[i].name, &buf.caen5730->event_index,
+                    rootFile);
+    } else if (branches[i].type == "caen1742") {
+      buf.caen1742.reset(new caen_1742);
+      buf.nChannels = CAEN_1742_CH;
+      buf.nTriggers = CAEN_1742_GR;
+      buf.traceLength = CAEN_1742_LN;
+      connectBranch(*t, branches[i].name, &buf.caen1742->system_clock,
+                    rootFile);
+    } else {
+      std::cerr << "unknown digitizer type " << branches[i].type
+                << ". exiting." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    std::memset(&headers[i], 0, sizeof(branchHeader));
+    std::strncpy(headers[i].name, branches[i].name.c_str(),
+                 sizeof(headers[i].name) - 1);
+    std::strncpy(headers[i].type, branches[i].type.c_str(),
+                 sizeof(headers[i].type) - 1);
+    headers[i].nChannels = buf.nChannels;
+    headers[i].nTriggers = buf.nTriggers;
+    headers[i].traceLength = buf.traceLength;
+    headers[i].dataOffset = offset;
+    offset = roundUpToPage(offset + nEntries *
+                                        (buf.nChannels + buf.nTriggers) *
+                                        buf.traceLength * sizeof(UShort_t));
+  }
+  const std::uint64_t fileSize = offset;
+
+  // map a temporary file and fill it column by column, it only gets the
+  // cache's name once it is complete
+  const std::string tmpPath = cachePath + ".tmp";
+  int fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if ((fd < 0) || (ftruncate(fd, fileSize) != 0)) {
+    std::cerr << "could not create " << tmpPath << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  char* base = (char*)mmap(nullptr, fileSize, PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    std::cerr << "could not map " << tmpPath << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // the magic is written last, a partial file is never taken for a cache
+  fileHeader header;
+  std::memset(header.magic, 0, sizeof(header.magic));
+  header.version = version;
+  header.nBranches = branches.size();
+  header.nEntries = nEntries;
+  std::memcpy(base, &header, sizeof(header));
+  std::memcpy(base + sizeof(header), headers.data(),
+              headers.size() * sizeof(branchHeader));
+
+  for (std::uint64_t entry = 0; entry < nEntries; ++entry) {
+    if (t->GetEntry(entry) <= 0) {
+      std::cerr << "could not read entry " << entry << " of " << rootFile
+                << std::endl;
+      munmap(base, fileSize);
+      std::remove(tmpPath.c_str());
+      exit(EXIT_FAILURE);
+    }
+    for (std::size_t i = 0; i < buffers.size(); ++i) {
+      const branchBuffer& buf = buffers[i];
+      UShort_t* column = (UShort_t*)(base + headers[i].dataOffset);
+      const std::uint32_t nColumns = buf.nChannels + buf.nTriggers;
+      for (std::uint32_t ch = 0; ch < nColumns; ++ch) {
+        std::memcpy(column + (ch * nEntries + entry) * buf.traceLength,
+                    buf.getTrace(ch), buf.traceLength * sizeof(UShort_t));
+      }
+    }
+  }
+
+  msync(base, fileSize, MS_SYNC);
+  std::memcpy(base, magic, sizeof(magic));
+  msync(base, pageSize, MS_SYNC);
+  munmap(base, fileSize);
+  if (std::rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+    std::cerr << "could not move " << tmpPath << " to " << cachePath
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+}
+
+TraceCache::TraceCache(const std::string& path)
+    : base_(nullptr), size_(0), header_(nullptr), branches_(nullptr) {
+  int fd = open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if ((fd < 0) || (fstat(fd, &st) != 0)) {
+    std::cerr << "could not open trace cache " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  size_ = st.st_size;
+  void* mapping = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::cerr << "could not map trace cache " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  base_ = static_cast<const char*>(mapping);
+
+  header_ = reinterpret_cast<const traceCache::fileHeader*>(base_);
+  if ((size_ < sizeof(traceCache::fileHeader)) ||
+      (std::memcmp(header_->magic, traceCache::magic,
+                   sizeof(traceCache::magic)) != 0) ||
+      (header_->version != traceCache::version)) {
+    std::cerr << path << " is not a version " << traceCache::version
+              << " trace cache" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  branches_ = reinterpret_cast<const traceCache::branchHeader*>(
+      base_ + sizeof(traceCache::fileHeader));
+
+  // every column must lie inside the file
+  bool complete = sizeof(traceCache::fileHeader) +
+                      header_->nBranches * sizeof(traceCache::branchHeader) <=
+                  size_;
+  for (std::uint32_t i = 0; complete && (i < header_->nBranches); ++i) {
+    const traceCache::branchHeader& b = branches_[i];
+    const std::uint64_t columnBytes =
+        header_->nEntries * (b.nChannels + b.nTriggers) * b.traceLength *
+        sizeof(UShort_t);
+    complete = (b.dataOffset <= size_) && (columnBytes <= size_ - b.dataOffset);
+  }
+  if (!complete) {
+    std::cerr << "trace cache " << path << " is truncated" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // traces are read front to back within a column
+  madvise(mapping, size_, MADV_SEQUENTIAL);
+}
+
+TraceCache::~TraceCache() {
+  munmap(const_cast<char*>(base_), size_);
+}
+
+int TraceCache::findBranch(const std::string& branchName) const {
+  for (std::uint32_t i = 0; i < header_->nBranches; ++i) {
+    if (branchName == branches_[i].name) {
+      return i;
+    }
+  }
+  return -1;
+}
@@ -5,6 +5,8 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <cassert>
 
 #include "TFile.h"
 #include "TF1.h"
@@ -30,6 +32,110 @@ json11::Json valueFromDetectorOrDefault(const std::string& key,
   }
 }
 
+json11::Json valueFromDetectorOrDefault(const std::string& key,
+                                        const json11::Json::object& detector,
+                                        const json11::Json::object& def,
+                                        const json11::Json& fallback) {
+  if (detector.find(key) != detector.end()) {
+    return detector.at(key);
+  } else if (def.find(key) != def.end()) {
+    return def.at(key);
+  } else {
+    return fallback;
+  }
+}
+
+namespace {
+// number of points at which the template spline is sampled
+const int templateResolution = 10000;
+}
+
+void setFitterTemplate(detector& det) {
+  det.fitter.setTemplate(det.templateSpline.get(),
+                         -1 * det.conf.templateBuffer,
+                         det.conf.templateLength - det.conf.templateBuffer,
+                         templateResolution);
+  det.fitSamples.resize(det.conf.fitLength);
+  if (det.bundle) {
+    det.tabTemplate =
+        det.bundle->get(templateBundle::masterTable)
+            .clipped(-1 * det.conf.templateBuffer,
+                     det.conf.templateLength - det.conf.templateBuffer);
+  } else {
+    det.tabTemplate = TabulatedTemplate(
+        *det.templateSpline, -1 * det.conf.templateBuffer,
+        det.conf.templateLength - det.conf.templateBuffer, templateResolution);
+  }
+  det.linearFit = LinearTemplateFit();
+  if (det.conf.linearFit) {
+    // accepted fits are within wiggleRoom of peakIndex, one sample of
+    // margin keeps the minimum off the grid edge
+    det.linearFit = LinearTemplateFit(
+        det.tabTemplate, det.conf.fitLength,
+        det.conf.peakIndex - det.conf.wiggleRoom - 1.0,
+        det.conf.peakIndex + det.conf.wiggleRoom + 1.0,
+        det.conf.linearFitResolution);
+  }
+}
+
+void cloneDetector(const detector& source, detector& copy) {
+  copy.name = source.name;
+  copy.conf = source.conf;
+  copy.bundle = source.bundle;
+  copy.templateSpline.reset((TSpline3*)source.templateSpline->Clone());
+  copy.fitter.setTemplate(copy.templateSpline.get(),
+                          -1 * copy.conf.templateBuffer,
+                          copy.conf.templateLength - copy.conf.templateBuffer,
+                          templateResolution);
+  copy.tabTemplate = source.tabTemplate;
+  copy.linearFit = source.linearFit;
+  copy.fitSamples.resize(copy.conf.fitLength);
+  copy.pSum = source.pSum;
+}
+
+bool digitizer::needsTriggerTimes() const {
+  if (triggerCorrection) {
+    return true;
+  }
+  for (const auto& det : detectors) {
+    if (det.conf.searchFromTrigger) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void digitizer::copyConfiguration(digitizer& copy) const {
+  copy.type = type;
+  copy.branchName = branchName;
+  copy.triggerCorrection = triggerCorrection;
+  copy.minTriggerAmplitude = minTriggerAmplitude;
+  copy.triggerTimes.resize(triggerTimes.size());
+  copy.detectors.resize(detectors.size());
+  for (std::size_t i = 0; i < detectors.size(); ++i) {
+    cloneDetector(detectors[i], copy.detectors[i]);
+  }
+}
+
+std::unique_ptr<digitizer> digitizerCaen5730::clone() const {
+  std::unique_ptr<digitizer> copy(new digitizerCaen5730);
+  copyConfiguration(*copy);
+  return copy;
+}
+
+std::unique_ptr<digitizer> digitizerCaen1742::clone() const {
+  std::unique_ptr<digitizer> copy(new digitizerCaen1742);
+  copyConfiguration(*copy);
+  return copy;
+}
+
+void fitWindow(detector& det, const UShort_t* samples, std::size_t n,
+               double tGuess, TemplateFitter::Output& out) {
+  assert(det.fitSamples.size() == n);
+  std::copy(samples, samples + n, det.fitSamples.begin());
+  out = det.fitter.fit(det.fitSamples, tGuess);
+}
+
 json11::Json parseConfig(const std::string& confFileName,
                          std::vector<std::unique_ptr<digitizer>>& digs) {
   std::stringstream ss;
@@ -51,10 +157,7 @@ json11::Json parseConfig(const std::string& confFileName,
   for (const auto& digEntry : confJson["digitizers"].array_items()) {
     auto digMap = digEntry.object_items();
     auto type = digMap.at("type").string_value();
-    if (type == "caen5730") {
-      digs.emplace_back(new digitizerCaen5730);
-    } else if (type=="caen1742"){
-    } else {
+    if ((type != "caen5730") && (type != "caen1742")) {
       std::cerr << "unknown digitizer type " << type << ". exiting." << std::endl;
       exit(EXIT_FAILURE);
     }
@@ -63,10 +166,29 @@ json11::Json parseConfig(const std::string& confFileName,
       continue;
     }
 
+    if (type == "caen5730") {
+      digs.emplace_back(new digitizerCaen5730);
+    } else {
+      digs.emplace_back(new digitizerCaen1742);
+    }
+
     digs.back()->type = type;
 
     digs.back()->branchName = digMap.at("branchName").string_value();
 
+    digs.back()->triggerCorrection = digEntry["triggerCorrection"].bool_value();
+    if (digs.back()->triggerCorrection && (digs.back()->getNGroups() == 0)) {
+      std::cerr << type << " has no trigger groups, ignoring triggerCorrection"
+                << std::endl;
+      digs.back()->triggerCorrection = false;
+    }
+    digs.back()->triggerTimes.resize(digs.back()->getNGroups());
+    // optional, smaller pulses on a trigger trace are treated as noise
+    digs.back()->minTriggerAmplitude =
+        digEntry["minTriggerAmplitude"].is_number()
+            ? digEntry["minTriggerAmplitude"].number_value()
+            : 100;
+
     for (const auto detEntry : digEntry["detectors"].array_items()) {
       auto detectorMap = detEntry.object_items();
 
@@ -75,11 +197,12 @@ json11::Json parseConfig(const std::string& confFileName,
 
       thisDetector.name = detectorMap.at("name").string_value();
 
-      TFile templateFile(
-          (confMap.at("templateBaseDir").string_value() + "/" +
-           detectorMap.at("templateFile").string_value()).c_str());
-      thisDetector.templateSpline.reset(
-          (TSpline3*)templateFile.Get("masterSpline"));
+      // detectors sharing a template file share one bundle
+      thisDetector.bundle = TemplateBundle::load(
+          confMap.at("templateBaseDir").string_value() + "/" +
+          detectorMap.at("templateFile").string_value());
+      thisDetector.templateSpline =
+          thisDetector.bundle->makeSpline(templateBundle::masterTable);
 
       thisDetector.conf.channel = detectorMap.at("channel").int_value();
 
@@ -98,17 +221,51 @@ json11::Json parseConfig(const std::string& confFileName,
       thisDetector.conf.wiggleRoom =
           valueFromDetectorOrDefault("wiggleRoom", detectorMap, defaults)
               .int_value();   
+      // optional, every pulse is fit unless configured
+      thisDetector.conf.fitThreshold =
+          valueFromDetectorOrDefault("fitThreshold", detectorMap, defaults, 0)
+              .number_value();
+      // optional, by default the whole trace is searched
+      const json11::Json searchWindow = valueFromDetectorOrDefault(
+          "searchWindow", detectorMap, defaults, json11::Json());
+      thisDetector.conf.searchStart = searchWindow["start"].int_value();
+      thisDetector.conf.searchLength = searchWindow["length"].int_value();
+      const std::string reference =
+          searchWindow["reference"].is_string()
+              ? searchWindow["reference"].string_value()
+              : "trace";
+      thisDetector.conf.searchFromTrigger = reference == "trigger";
+      if ((reference != "trace") && (reference != "trigger")) {
+        std::cerr << "Error: unknown searchWindow reference " << reference
+                  << " for " << thisDetector.name
+                  << ", use \"trace\" or \"trigger\"" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      if (thisDetector.conf.searchFromTrigger &&
+          (digs.back()->getNGroups() == 0)) {
+        std::cerr << type << " has no trigger groups, searchWindow of "
+                  << thisDetector.name << " is relative to the trace"
+                  << std::endl;
+        thisDetector.conf.searchFromTrigger = false;
+      }
       thisDetector.conf.negPolarity =
           valueFromDetectorOrDefault("negPolarity", detectorMap, defaults)
               .bool_value();
       thisDetector.conf.draw = valueFromDetectorOrDefault(
                                    "draw", detectorMap, defaults).bool_value();
-
-      thisDetector.fitter.setTemplate(
-          thisDetector.templateSpline.get(),
-          -1 * thisDetector.conf.templateBuffer,
-          thisDetector.conf.templateLength - thisDetector.conf.templateBuffer,
-          10000);
+      // optional, off unless configured
+      thisDetector.conf.threeSampleSeed =
+          valueFromDetectorOrDefault("threeSampleSeed", detectorMap, defaults,
+                                     false).bool_value();
+      // optional, off unless configured
+      thisDetector.conf.linearFit =
+          valueFromDetectorOrDefault("linearFit", detectorMap, defaults,
+                                     false).bool_value();
+      thisDetector.conf.linearFitResolution =
+          valueFromDetectorOrDefault("linearFitResolution", detectorMap,
+                                     defaults, 50).int_value();
+
+      setFitterTemplate(thisDetector);
 
       if (!drawingAny) {
         drawingAny = thisDetector.conf.draw;
@@ -123,32 +280,36 @@ json11::Json parseConfig(const std::string& confFileName,
   return confJson;
 }
 
-void displayFit(TemplateFitter& tf, const TemplateFitter::Output& out,
+void displayFit(TemplateFitter* tf, const TemplateFitter::Output& out,
                 const std::vector<UShort_t>& sampleTimes, const std::vector<UShort_t>& trace,
                 const detector& det) {
   const int nPulses = out.times.size();
+  // the linear fit has no covariance, its results are shown without errors
+  auto error = [&](int i) { return tf ? sqrt(tf->getCovariance(i, i)) : 0; };
 
   // print to terminal
-  std::cout << det.name << std::endl;
+  std::cout << det.name << (tf ? "" : " (linear fit)") << std::endl;
 
   for (int i = 0; i < nPulses; ++i) {
     std::cout << "t" << i + 1 << ": " << out.times[0] + sampleTimes[0]
-              << " +/- " << sqrt(tf.getCovariance(i, i)) << std::endl;
+              << " +/- " << error(i) << std::endl;
     std::cout << "scale" << i + 1 << ": " << out.scales[0] << " +/- "
-              << sqrt(tf.getCovariance(i + nPulses, i + nPulses)) << std::endl;
+              << error(i + nPulses) << std::endl;
   }
   std::cout << "pedestal: " << out.pedestal << " +/- "
-            << sqrt(tf.getCovariance(2 * nPulses, 2 * nPulses)) << std::endl;
+            << error(2 * nPulses) << std::endl;
   std::cout << "chi2: " << out.chi2 << std::endl;
   std::cout << std::endl;
-  std::cout << "covariance matrix" << std::endl;
-  for (int i = 0; i < 2 * nPulses + 1; ++i) {
-    for (int j = 0; j < 2 * nPulses + 1; ++j) {
-      std::cout << std::setw(12) << tf.getCovariance(i, j) << " ";
+  if (tf) {
+    std::cout << "covariance matrix" << std::endl;
+    for (int i = 0; i < 2 * nPulses + 1; ++i) {
+      for (int j = 0; j < 2 * nPulses + 1; ++j) {
+        std::cout << std::setw(12) << tf->getCovariance(i, j) << " ";
+      }
+      std::cout << std::endl;
     }
     std::cout << std::endl;
   }
-  std::cout << std::endl;
 
   // make plot
   std::unique_ptr<TCanvas> c(new TCanvas((det.name + "_canvas").c_str(),
@@ -160,7 +321,7 @@ void displayFit(TemplateFitter& tf, const TemplateFitter::Output& out,
     g->SetPoint(g->GetN(), sampleTimes[i], trace[i]);
   }
 
-  const TSpline* tSpline = det.templateSpline.get();
+  const TabulatedTemplate& tabTemplate = det.tabTemplate;
   // room for up to three pulses
   auto templateFunction = [&](double* x, double* p) {
     double returnValue = p[6];
@@ -168,7 +329,7 @@ void displayFit(TemplateFitter& tf, const TemplateFitter::Output& out,
       if ((x[0] - p[2 * i] > -1 * det.conf.templateBuffer) &&
           (x[0] - p[2 * i] <
            det.conf.templateLength - det.conf.templateBuffer)) {
-        returnValue += p[1 + 2 * i] * tSpline->Eval(x[0] - p[2 * i]);
+        returnValue += p[1 + 2 * i] * tabTemplate.eval(x[0] - p[2 * i]);
       }
     }
     return returnValue;
@@ -197,13 +358,13 @@ void displayFit(TemplateFitter& tf, const TemplateFitter::Output& out,
     func->SetParameter(2 * i, out.times[i] + sampleTimes[0]);
     txtbox->AddText(Form("t_{%i}: %.3f #pm %.3f", i + 1,
                          out.times[i] + sampleTimes[0],
-                         sqrt(tf.getCovariance(i, i))));
+                         error(i)));
     func->SetParameter(2 * i + 1, out.scales[i]);
     txtbox->AddText(Form("E_{%i}: %.0f #pm %.0f", i + 1, out.scales[i],
-                         sqrt(tf.getCovariance(nPulses + i, nPulses + i))));
+                         error(nPulses + i)));
   }
   txtbox->AddText(Form("pedestal: %.0f #pm %.1f", out.pedestal,
-                       sqrt(tf.getCovariance(2 * nPulses, 2 * nPulses))));
+                       error(2 * nPulses)));
   txtbox->AddText(Form("#chi^{2} / NDF : %.2f", out.chi2));
 
   std::vector<std::unique_ptr<TF1>> components;